@@ -0,0 +1,173 @@
+#pragma once
+
+/********************************************************************
+ * bench.h: Helpers for the benchmarks and checks in bench/
+ * (C) 2026, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <string>
+
+#include "config.h"
+#include "fans.h"
+#include "sensors.h"
+#include "temperature_state.h"
+
+namespace thinkfan {
+namespace bench {
+
+
+/// @brief Keep the compiler from optimizing away the computation of @a value.
+template<typename T>
+inline void keep(const T &value)
+{ asm volatile("" : : "g"(&value) : "memory"); }
+
+
+/// @return The average time in nanoseconds that one call of @a fn takes over @a iterations calls.
+template<typename FnT>
+double ns_per_call(unsigned int iterations, FnT &&fn)
+{
+	using clock = std::chrono::steady_clock;
+
+	auto start = clock::now();
+	for (unsigned int i = 0; i < iterations; ++i)
+		fn();
+	return std::chrono::duration<double, std::nano>(clock::now() - start).count() / iterations;
+}
+
+
+/// @brief Print @a what and exit with an error if @a ok is false.
+inline void check(bool ok, const char *what)
+{
+	if (!ok) {
+		std::fprintf(stderr, "FAILED: %s\n", what);
+		std::exit(EXIT_FAILURE);
+	}
+}
+
+
+/// @brief A temporary directory to put fake sysfs (or procfs) files in. Removed on destruction.
+class FakeSysfs {
+public:
+	FakeSysfs()
+	{
+		std::string tmpl = (std::filesystem::temp_directory_path() / "thinkfan-bench.XXXXXX").string();
+		check(::mkdtemp(tmpl.data()), "mkdtemp()");
+		root_ = tmpl;
+	}
+
+	~FakeSysfs()
+	{
+		std::error_code ec;
+		std::filesystem::remove_all(root_, ec);
+	}
+
+	/// @return The absolute path of @a rel_path
+	std::string path(const std::string &rel_path) const
+	{ return (root_ / rel_path).string(); }
+
+	/// @brief Replace the content of @a rel_path with @a content, creating it as necessary.
+	void write(const std::string &rel_path, const std::string &content) const
+	{
+		std::filesystem::create_directories((root_ / rel_path).parent_path());
+		std::ofstream f(path(rel_path), std::ios::trunc);
+		f << content;
+		check(bool(f), "writing a fake sysfs file");
+	}
+
+	/// @return The content of @a rel_path
+	std::string read(const std::string &rel_path) const
+	{
+		std::ifstream f(path(rel_path));
+		return std::string(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+	}
+
+	/// @brief Write @a yaml to a config file in here and parse it.
+	std::unique_ptr<const Config> load_config(const std::string &yaml) const
+	{
+		write("thinkfan.yaml", yaml);
+		return std::unique_ptr<const Config>(Config::read_config({ path("thinkfan.yaml") }));
+	}
+
+	/** @brief Set up a fake hwmon0 with @a num_sensors temperature inputs and a pwm1 fan, load a
+	 *  config with two levels for it and initialize it with @a ts.
+	 *  Input N reads 41 + N degrees. They're all in one sensor entry, so sensors()[0] reads all of
+	 *  them. If @a optional_extra is set, there is one more input, in an optional sensor entry of
+	 *  its own at sensors()[1].
+	 *  If a @a fan_mapping is given (e.g. a "pid:" section), it goes into the fan entry instead of
+	 *  the levels. */
+	std::unique_ptr<const Config> hwmon_config(
+		TemperatureState &ts,
+		unsigned int num_sensors,
+		bool optional_extra = false,
+		const std::string &fan_mapping = ""
+	) const {
+		const unsigned int num_files = num_sensors + (optional_extra ? 1 : 0);
+		for (unsigned int i = 1; i <= num_files; ++i)
+			write("hwmon0/temp" + std::to_string(i) + "_input", std::to_string((41 + i) * 1000) + "\n");
+		write("hwmon0/pwm1", "0\n");
+		write("hwmon0/pwm1_enable", "2\n");
+
+		std::string indices;
+		for (unsigned int i = 1; i <= num_sensors; ++i)
+			indices += (i > 1 ? ", " : "") + std::to_string(i);
+
+		std::string yaml =
+			"sensors:\n"
+			"  - hwmon: " + path("hwmon0") + "\n"
+			"    indices: [" + indices + "]\n";
+		if (optional_extra)
+			yaml +=
+				"  - hwmon: " + path("hwmon0") + "\n"
+				"    indices: [" + std::to_string(num_files) + "]\n"
+				"    optional: true\n";
+		yaml +=
+			"fans:\n"
+			"  - hwmon: " + path("hwmon0") + "\n"
+			"    indices: [1]\n";
+		if (fan_mapping.empty())
+			yaml +=
+				"levels:\n"
+				"  - [0, 0, 100]\n"
+				"  - [255, 90, 32767]\n";
+		else {
+			std::istringstream lines(fan_mapping);
+			for (std::string line; std::getline(lines, line);)
+				yaml += "    " + line + "\n";
+		}
+
+		std::unique_ptr<const Config> config = load_config(yaml);
+		config->init(ts);
+		return config;
+	}
+
+private:
+	std::filesystem::path root_;
+};
+
+
+} // namespace bench
+} // namespace thinkfan
@@ -0,0 +1,144 @@
+/********************************************************************
+ * bench_depulse.cpp: Check the timing of depulsing on a fake tpacpi fan
+ * (C) 2026, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+#include "bench.h"
+
+#include <cmath>
+#include <csignal>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+// The daemon's main(), renamed for the bench library
+int thinkfan_main(int argc, char **argv);
+
+using namespace thinkfan;
+using clock_type = std::chrono::steady_clock;
+
+
+// The cycle time and the depulse time that thinkfan is started with
+static constexpr double cycle_s = 1;
+static constexpr double depulse_s = 0.3;
+// How far the timing may be off, e.g. on a loaded machine
+static constexpr double tolerance_s = 0.1;
+
+
+struct FanWrite {
+	double time;
+	bool disengaged;
+};
+
+
+/// @brief Record a write to the fan file for every event on @a inotify_fd until @a end.
+static std::vector<FanWrite> watch_fan(int inotify_fd, const bench::FakeSysfs &sysfs,
+	clock_type::time_point start, clock_type::time_point end)
+{
+	std::vector<FanWrite> writes;
+	pollfd pfd { inotify_fd, POLLIN, 0 };
+
+	while (clock_type::now() < end) {
+		int timeout = int(std::chrono::duration_cast<std::chrono::milliseconds>(end - clock_type::now()).count()) + 1;
+		if (::poll(&pfd, 1, timeout) <= 0)
+			continue;
+
+		double t = std::chrono::duration<double>(clock_type::now() - start).count();
+		char buf[4096];
+		while (::read(inotify_fd, buf, sizeof(buf)) > 0);
+
+		// Writes go to offset 0 without truncating, so a shorter write leaves the rest of a longer one.
+		writes.push_back({ t, sysfs.read("fan").compare(0, 7, "level d") == 0 });
+	}
+
+	return writes;
+}
+
+
+int main()
+{
+	bench::FakeSysfs sysfs;
+	sysfs.write("hwmon0/temp1_input", "45000\n");
+	sysfs.write("fan",
+		"status:\t\tenabled\n"
+		"speed:\t\t2000\n"
+		"level:\t\tauto\n"
+		"commands:\tlevel <level> (<level> is 0-7, auto, disengaged, full-speed)\n"
+		"commands:\tenable, disable\n"
+		"commands:\twatchdog <timeout> (<timeout> is 0 (off), 1-120 (seconds))\n"
+	);
+	sysfs.write("thinkfan.yaml",
+		"sensors:\n"
+		"  - hwmon: " + sysfs.path("hwmon0") + "\n"
+		"    indices: [1]\n"
+		"fans:\n"
+		"  - tpacpi: " + sysfs.path("fan") + "\n"
+		"levels:\n"
+		"  - [1, 0, 60]\n"
+		"  - [7, 55, 32767]\n"
+	);
+
+	std::string config_file = sysfs.path("thinkfan.yaml");
+	std::string depulse_arg = "-p" + std::to_string(depulse_s);
+	std::vector<const char *> args { "thinkfan", "-n", "-q", "-s", "1", depulse_arg.c_str(), "-c", config_file.c_str() };
+
+	int inotify_fd = ::inotify_init1(IN_NONBLOCK);
+	bench::check(inotify_fd >= 0, "inotify_init1()");
+	bench::check(::inotify_add_watch(inotify_fd, sysfs.path("fan").c_str(), IN_MODIFY) >= 0, "inotify_add_watch()");
+
+	const double duration_s = 5.5;
+	auto start = clock_type::now();
+	auto end = start + std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>(duration_s));
+	int rv = -1;
+	std::thread daemon([&] () { rv = thinkfan_main(int(args.size()), const_cast<char **>(args.data())); } );
+
+	std::vector<FanWrite> writes = watch_fan(inotify_fd, sysfs, start, end);
+
+	::kill(::getpid(), SIGINT);
+	daemon.join();
+	::close(inotify_fd);
+	bench::check(rv == 0, "thinkfan exited with an error");
+
+	std::vector<double> disengaged;
+	for (size_t i = 0; i < writes.size(); ++i) {
+		std::printf("%6.3f s: %s\n", writes[i].time, writes[i].disengaged ? "disengaged" : "engaged");
+		if (!writes[i].disengaged)
+			continue;
+
+		disengaged.push_back(writes[i].time);
+		if (i + 1 < writes.size()) {
+			bench::check(!writes[i + 1].disengaged, "The fan was disengaged twice in a row");
+			double depulse = writes[i + 1].time - writes[i].time;
+			bench::check(std::abs(depulse - depulse_s) < tolerance_s, "The fan was not re-engaged after the depulse time");
+		}
+	}
+
+	bench::check(disengaged.size() >= 4, "The fan was not depulsed in every cycle");
+	bench::check(!writes.back().disengaged || writes.back().time > duration_s - depulse_s - tolerance_s,
+		"The fan was left disengaged");
+	for (size_t i = 1; i < disengaged.size(); ++i)
+		bench::check(std::abs(disengaged[i] - disengaged[i - 1] - cycle_s) < tolerance_s,
+			"Depulsing changed the cycle time");
+
+	std::printf("Depulsed %zu times, every %.1f s for %.1f s.\n", disengaged.size(), cycle_s, depulse_s);
+	return 0;
+}
@@ -0,0 +1,67 @@
+/********************************************************************
+ * bench_failing_sensor.cpp: Per-cycle cost of an optional sensor that always fails
+ * (C) 2026, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+#include "bench.h"
+#include "error.h"
+#include "message.h"
+#include "temperature_state.h"
+
+using namespace thinkfan;
+
+
+int main()
+{
+	bench::FakeSysfs sysfs;
+	TemperatureState ts(0);
+	unique_ptr<const Config> config = sysfs.hwmon_config(ts, 1, true);
+	SensorDriver &healthy = *config->sensors()[0];
+	SensorDriver &failing = *config->sensors()[1];
+
+	// From now on, every read of the optional sensor fails with EINVAL
+	sysfs.write("hwmon0/temp2_input", "garbage\n");
+
+	healthy.read_temps();
+	failing.read_temps();
+	ts.update();
+	bench::check(ts.temps()[0] == 42, "The healthy sensor has the wrong temperature");
+	bench::check(ts.temps()[1] == -128, "The failing optional sensor wasn't ignored");
+	bench::check(failing.initialized(), "The failing optional sensor has been dropped");
+
+	const unsigned int iterations = 200000;
+	double healthy_ns = bench::ns_per_call(iterations, [&] () { healthy.read_temps(); });
+	double failing_ns = bench::ns_per_call(iterations, [&] () { failing.read_temps(); });
+
+	// What the exception-based protocol paid on top of that for every failed read
+	const string path = failing.path();
+	double throw_ns = bench::ns_per_call(iterations, [&] () {
+		try {
+			throw IOerror(MSG_T_GET(path), EINVAL);
+		} catch (ExpectedError &e) {
+			bench::keep(IOStatus(e));
+		}
+	} );
+
+	std::printf("Healthy sensor:                   %7.0f ns per read\n", healthy_ns);
+	std::printf("Failing optional sensor:          %7.0f ns per read\n", failing_ns);
+	std::printf("Throwing and catching that error: %7.0f ns\n", throw_ns);
+
+	return 0;
+}
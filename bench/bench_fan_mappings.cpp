@@ -0,0 +1,260 @@
+/********************************************************************
+ * bench_fan_mappings.cpp: Check the PWM values the PID and curve mappings write to a fake hwmon fan
+ * (C) 2026, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+#include "bench.h"
+#include "temperature_state.h"
+
+namespace thinkfan {
+
+
+/// @brief Steps a PidMapping with a fixed dt (it's a friend).
+class PidMappingCheck {
+public:
+	/// @brief Do what PidMapping::set_fanspeed() does, @a dt seconds after the last step.
+	static void step(PidMapping &pid, const TemperatureState &ts, float dt)
+	{ pid.write_output(pid.compute(ts, dt)); }
+};
+
+
+} // namespace thinkfan
+
+using namespace thinkfan;
+
+
+/** @brief A fake hwmon fan, driven by the mapping in @a fan_mapping from two temperature inputs.
+ *  The mapping follows the first one. The second one stays at 0 or 1 degrees, so changing it
+ *  changes the TemperatureState, but not its aggregate. */
+class FakeFan {
+public:
+	FakeFan(const string &fan_mapping)
+	: ts_(0)
+	, config_(sysfs_.hwmon_config(ts_, 2, false, fan_mapping))
+	{
+		sysfs_.write("hwmon0/temp2_input", "0\n");
+		read_temps();
+	}
+
+	FanConfig &mapping() const
+	{ return *config_->fan_configs().front(); }
+
+	const TemperatureState &ts() const
+	{ return ts_; }
+
+	void set_temp(int temp)
+	{
+		sysfs_.write("hwmon0/temp1_input", std::to_string(temp * 1000) + "\n");
+		read_temps();
+	}
+
+	/// @brief Change the second input only
+	void touch()
+	{
+		background_ = !background_;
+		sysfs_.write("hwmon0/temp2_input", std::to_string(background_ * 1000) + "\n");
+		read_temps();
+	}
+
+	/// @return The PWM value written to the fan since the last call, -1 if there was none
+	int written() const
+	{
+		string pwm = sysfs_.read("hwmon0/pwm1");
+		sysfs_.write("hwmon0/pwm1", "");
+		return pwm.empty() ? -1 : std::stoi(pwm);
+	}
+
+private:
+	void read_temps()
+	{
+		config_->sensors().front()->read_temps();
+		ts_.update();
+	}
+
+	bench::FakeSysfs sysfs_;
+	TemperatureState ts_;
+	unique_ptr<const Config> config_;
+	bool background_ = false;
+};
+
+
+static unsigned int checks = 0;
+
+static void expect_written(FakeFan &fan, int pwm, const char *what)
+{
+	bench::check(fan.written() == pwm, what);
+	++checks;
+}
+
+
+static void check_pid_output_limits()
+{
+	// Proportional only, so the output is 2 * (temp - 50) clamped to [20, 100]
+	FakeFan fan(
+		"pid:\n"
+		"  setpoint: 50\n"
+		"  kp: 2\n"
+		"  ki: 0\n"
+		"  kd: 0\n"
+		"  min_output: 20\n"
+		"  max_output: 100\n"
+		"  min_delta: 5\n"
+	);
+	fan.written();
+
+	auto expect = [&] (int temp, int pwm, const char *what) {
+		fan.set_temp(temp);
+		fan.mapping().set_fanspeed(fan.ts());
+		expect_written(fan, pwm, what);
+	};
+
+	fan.set_temp(70);
+	fan.mapping().init_fanspeed(fan.ts());
+	expect_written(fan, 40, "PID: The initial output wasn't written");
+
+	expect(71, -1, "PID: A change below min_delta was written");
+	expect(72, -1, "PID: A change below min_delta was written");
+	expect(73, 46, "PID: A change of min_delta wasn't written");
+	expect(95, 90, "PID: A large change wasn't written");
+	expect(97, -1, "PID: A change below min_delta was written");
+	expect(99, 98, "PID: A change of min_delta wasn't written");
+	expect(100, 100, "PID: Reaching max_output by less than min_delta wasn't written");
+	expect(120, -1, "PID: Staying at max_output was written again");
+	expect(61, 22, "PID: A large change wasn't written");
+	expect(60, 20, "PID: Reaching min_output by less than min_delta wasn't written");
+	expect(30, -1, "PID: Staying at min_output was written again");
+}
+
+
+static void check_pid_anti_windup()
+{
+	FakeFan fan(
+		"pid:\n"
+		"  setpoint: 50\n"
+		"  kp: 1\n"
+		"  ki: 1\n"
+		"  kd: 0\n"
+		"  max_output: 100\n"
+	);
+	fan.written();
+	PidMapping &pid = dynamic_cast<PidMapping &>(fan.mapping());
+
+	auto expect = [&] (int temp, int pwm, const char *what) {
+		fan.set_temp(temp);
+		PidMappingCheck::step(pid, fan.ts(), 1);
+		expect_written(fan, pwm, what);
+	};
+
+	fan.set_temp(50);
+	pid.init_fanspeed(fan.ts());
+	expect_written(fan, 0, "PID: The initial output wasn't written");
+
+	// Error 10: 10 from kp, and the integral grows by 10 per second
+	expect(60, 20, "PID: Wrong output while integrating");
+	expect(60, 30, "PID: Wrong output while integrating");
+	expect(60, 40, "PID: Wrong output while integrating");
+
+	// Saturated for a long time. The integral must stay at 30 instead of winding up.
+	expect(150, 100, "PID: Wrong output when saturated");
+	for (int i = 0; i < 20; ++i)
+		expect(150, -1, "PID: Wrong output when saturated");
+
+	// Error -10: -10 from kp, plus the integral, which is now 20. Had it wound up to its limit of
+	// 100, the output would still be at 80.
+	expect(40, 10, "PID: The integral has wound up while the output was saturated");
+}
+
+
+static const char *const curve =
+	"curve:\n"
+	"  points: [[40, 0], [50, 100], [60, 255]]\n"
+	"  hysteresis: 3\n";
+
+
+static void check_curve_table()
+{
+	FakeFan fan(curve);
+	fan.written();
+
+	auto expect = [&] (int temp, int pwm, const char *what) {
+		fan.set_temp(temp);
+		fan.mapping().set_fanspeed(fan.ts());
+		expect_written(fan, pwm, what);
+	};
+
+	fan.set_temp(30);
+	fan.mapping().init_fanspeed(fan.ts());
+	expect_written(fan, 0, "Curve: Wrong PWM below the first point");
+
+	expect(45, 50, "Curve: Wrong PWM between points");
+	expect(47, 70, "Curve: Wrong PWM between points");
+	expect(50, 100, "Curve: Wrong PWM on a point");
+	expect(55, 178, "Curve: Wrong PWM between points (not rounded to nearest)");
+	expect(70, 255, "Curve: Wrong PWM above the last point");
+
+	// Going down, the curve is shifted by the hysteresis: 255 until 57 degrees, then 59's 240
+	expect(59, -1, "Curve: Went down within the hysteresis");
+	expect(57, -1, "Curve: Went down within the hysteresis");
+	expect(56, 240, "Curve: Didn't go down below the hysteresis");
+	// Going back up, nothing changes until the curve itself exceeds the current PWM
+	expect(57, -1, "Curve: Went up without exceeding the current PWM");
+	expect(58, -1, "Curve: Went up without exceeding the current PWM");
+	expect(59, -1, "Curve: Went up without exceeding the current PWM");
+	expect(60, 255, "Curve: Didn't go up when the curve exceeded the current PWM");
+}
+
+
+static void check_curve_fixed_point()
+{
+	FakeFan fan(curve);
+	fan.written();
+
+	fan.set_temp(30);
+	fan.mapping().init_fanspeed(fan.ts());
+	fan.written();
+
+	for (int temp = 30; temp <= 70; ++temp) {
+		for (int from : { 30, 70 }) {
+			fan.set_temp(from);
+			fan.mapping().set_fanspeed(fan.ts());
+			fan.set_temp(temp);
+			fan.mapping().set_fanspeed(fan.ts());
+			fan.written();
+
+			// One evaluation must settle it: Another one at the same temperature writes nothing
+			fan.touch();
+			bench::check(fan.mapping().set_fanspeed(fan.ts()) == false,
+				"Curve: Changed the PWM at a constant temperature");
+			expect_written(fan, -1, "Curve: Wrote the PWM at a constant temperature");
+		}
+	}
+}
+
+
+int main()
+{
+	check_pid_output_limits();
+	check_pid_anti_windup();
+	check_curve_table();
+	check_curve_fixed_point();
+
+	std::printf("The PID and curve mappings wrote the expected PWM values in %u checks.\n", checks);
+
+	return 0;
+}
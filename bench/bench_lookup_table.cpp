@@ -0,0 +1,166 @@
+/********************************************************************
+ * bench_lookup_table.cpp: Check the simple level lookup table against the level walk
+ * (C) 2026, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+#include "bench.h"
+#include "temperature_state.h"
+
+#include <climits>
+#include <random>
+#include <vector>
+
+namespace thinkfan {
+
+
+/// @brief Gets at the internals of a StepwiseMapping (it's a friend).
+class StepwiseMappingCheck {
+public:
+	static void compile(StepwiseMapping &mapping, const TemperatureState &ts)
+	{ mapping.compile_levels(ts); }
+
+	static bool has_table(const StepwiseMapping &mapping)
+	{ return !mapping.lut_.empty(); }
+
+	static constexpr int max_table_width = StepwiseMapping::max_lut_width;
+
+	/// @return next_level() from @a cur with the table
+	static size_t looked_up(StepwiseMapping &mapping, size_t cur, const TemperatureState &ts)
+	{
+		mapping.cur_lvl_ = cur;
+		return mapping.next_level(ts);
+	}
+
+	/// @return next_level() from @a cur with the table taken away, i.e. by walking the levels
+	static size_t walked(StepwiseMapping &mapping, size_t cur, const TemperatureState &ts)
+	{
+		vector<uint16_t> table;
+		table.swap(mapping.lut_);
+		mapping.cur_lvl_ = cur;
+		size_t rv = mapping.next_level(ts);
+		table.swap(mapping.lut_);
+		return rv;
+	}
+};
+
+
+} // namespace thinkfan
+
+using namespace thinkfan;
+
+
+// The level walk on the configured limits, before they're clamped to int16_t
+static size_t reference_walk(const StepwiseMapping &mapping, size_t cur, int temp)
+{
+	const vector<unique_ptr<Level>> &levels = mapping.levels();
+	if (cur != levels.size() - 1 && temp >= levels[cur]->upper_limit().front()) {
+		while (cur != levels.size() - 1 && temp >= levels[cur]->upper_limit().front())
+			cur++;
+	}
+	else {
+		while (cur != 0 && temp < levels[cur]->lower_limit().front())
+			cur--;
+	}
+	return cur;
+}
+
+
+static void set_temp(TemperatureState &ts, TemperatureState::Ref &ref, int temp)
+{
+	ref.restart();
+	ref.add_temp(temp);
+	ts.update();
+}
+
+
+static int random_limit(std::mt19937 &rng, int spread)
+{
+	// Mostly limits close to each other, but also ones at and beyond the ends of the clamped range
+	switch (rng() % 16) {
+	case 0: return INT_MIN;
+	case 1: return INT_MAX;
+	case 2: return TemperatureState::temp_min - int(rng() % 3);
+	case 3: return TemperatureState::temp_max + int(rng() % 3);
+	case 4: return (rng() % 2 ? 1 : -1) * (40000 + int(rng() % 100000));
+	default: return int(rng() % unsigned(spread)) - spread / 4;
+	}
+}
+
+
+int main()
+{
+	std::mt19937 rng(4711);
+	TemperatureState ts(1);
+	TemperatureState::Ref ref = ts.ref(1);
+	unsigned int with_table = 0, without_table = 0;
+
+	for (int round = 0; round < 60; ++round) {
+		// Every third mapping spans more degrees than fit in a table
+		const int spread = round % 3 ? 200 : 4 * StepwiseMappingCheck::max_table_width;
+		const size_t num_levels = 1 + rng() % 8;
+
+		StepwiseMapping mapping;
+		int prev_upper = INT_MAX;
+		for (size_t lvl = 0; lvl < num_levels; ++lvl) {
+			// add_level() insists that each level's lower limit is at most the previous upper limit
+			const int lower = std::min(random_limit(rng, spread), prev_upper);
+			prev_upper = random_limit(rng, spread);
+			mapping.add_level(unique_ptr<Level>(new SimpleLevel(int(lvl), lower, prev_upper)));
+		}
+		StepwiseMappingCheck::compile(mapping, ts);
+		if (StepwiseMappingCheck::has_table(mapping))
+			++with_table;
+		else
+			++without_table;
+
+		for (int temp = TemperatureState::temp_min; temp <= TemperatureState::temp_max; ++temp) {
+			set_temp(ts, ref, temp);
+			for (size_t cur = 0; cur < num_levels; ++cur) {
+				const size_t walked = StepwiseMappingCheck::walked(mapping, cur, ts);
+				bench::check(StepwiseMappingCheck::looked_up(mapping, cur, ts) == walked,
+					"The lookup table differs from the level walk");
+				bench::check(reference_walk(mapping, cur, temp) == walked,
+					"The level walk differs from the configured limits");
+			}
+		}
+	}
+
+	bench::check(with_table > 0 && without_table > 0, "Expected mappings both with and without a table");
+	std::printf("next_level() matches the level walk for %u mappings with a lookup table and %u without.\n",
+		with_table, without_table);
+
+	// A typical config: 7 levels a few degrees apart, and a temperature that doesn't change the level
+	StepwiseMapping mapping;
+	for (int lvl = 0; lvl < 7; ++lvl)
+		mapping.add_level(unique_ptr<Level>(new SimpleLevel(lvl, lvl ? 40 + 5 * lvl : -128, 47 + 5 * lvl)));
+	StepwiseMappingCheck::compile(mapping, ts);
+	set_temp(ts, ref, 58);
+
+	const unsigned int iterations = 5000000;
+	double table_ns = bench::ns_per_call(iterations, [&] () {
+		bench::keep(StepwiseMappingCheck::looked_up(mapping, 3, ts));
+	} );
+	double walk_ns = bench::ns_per_call(iterations, [&] () {
+		bench::keep(StepwiseMappingCheck::walked(mapping, 3, ts));
+	} );
+
+	std::printf("7 levels: lookup table %5.1f ns, level walk %5.1f ns\n", table_ns, walk_ns);
+
+	return 0;
+}
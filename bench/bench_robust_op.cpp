@@ -0,0 +1,83 @@
+/********************************************************************
+ * bench_robust_op.cpp: Overhead of Driver::robust_op() around a sensor read
+ * (C) 2026, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+#include "bench.h"
+#include "error.h"
+#include "persistent_file.h"
+#include "temperature_state.h"
+
+#include <functional>
+
+using namespace thinkfan;
+
+
+static void skip(Driver *, const IOStatus &status)
+{ bench::keep(status); }
+
+
+int main()
+{
+	bench::FakeSysfs sysfs;
+	TemperatureState ts(0);
+	unique_ptr<const Config> config = sysfs.hwmon_config(ts, 1);
+	SensorDriver &sensor = *config->sensors()[0];
+
+	sensor.read_temps();
+	ts.update();
+	bench::check(ts.temps()[0] == 42, "The sensor has the wrong temperature");
+
+	PersistentFile file;
+	file.open(sysfs.path("hwmon0/temp1_input"));
+
+	const unsigned int iterations = 500000;
+	int temp;
+
+	// The I/O alone
+	double raw_ns = bench::ns_per_call(iterations, [&] () {
+		bench::keep(file.try_read_int(temp));
+	} );
+
+	// Everything a cycle does per sensor
+	double read_temps_ns = bench::ns_per_call(iterations, [&] () { sensor.read_temps(); });
+
+	// The same op through robust_op() as it is now, and as it was before it became a template:
+	// type-erased in a std::function, with the skip callback std::bind()ed into another one.
+	auto op = [&] () {
+		return file.try_read_int(temp) ? IOStatus::io_error("read", EIO) : IOStatus();
+	};
+	double template_ns = bench::ns_per_call(iterations, [&] () {
+		sensor.robust_op(op, [&] (const IOStatus &e) { skip(&sensor, e); });
+	} );
+	double function_ns = bench::ns_per_call(iterations, [&] () {
+		using namespace std::placeholders;
+		sensor.robust_op(
+			std::function<IOStatus ()>(op),
+			std::function<void (const IOStatus &)>(std::bind(&skip, &sensor, _1))
+		);
+	} );
+
+	std::printf("pread() and parse only:           %6.1f ns\n", raw_ns);
+	std::printf("SensorDriver::read_temps():       %6.1f ns\n", read_temps_ns);
+	std::printf("robust_op() with lambdas:         %6.1f ns\n", template_ns);
+	std::printf("robust_op() with std::function:   %6.1f ns\n", function_ns);
+
+	return 0;
+}
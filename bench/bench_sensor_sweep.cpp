@@ -0,0 +1,99 @@
+/********************************************************************
+ * bench_sensor_sweep.cpp: Compare a SensorSweep with reading sensors one by one
+ * (C) 2026, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+#include "bench.h"
+#include "message.h"
+#include "sensor_sweep.h"
+#include "temperature_state.h"
+
+using namespace thinkfan;
+
+
+static int fake_temp(unsigned int idx, int round)
+{ return 30 + int(idx % 50) + round; }
+
+
+static void write_temps(const bench::FakeSysfs &sysfs, unsigned int num_sensors, int round)
+{
+	for (unsigned int i = 1; i <= num_sensors; ++i)
+		sysfs.write("hwmon0/temp" + std::to_string(i) + "_input", std::to_string(fake_temp(i, round) * 1000) + "\n");
+}
+
+
+static void check_temps(const TemperatureState &ts, unsigned int num_sensors, int round, const char *what)
+{
+	for (unsigned int i = 0; i < num_sensors; ++i)
+		bench::check(ts.temps()[i] == fake_temp(i + 1, round), what);
+}
+
+
+static void bench_sweep(unsigned int num_sensors)
+{
+	bench::FakeSysfs sysfs;
+	TemperatureState ts(0);
+	unique_ptr<const Config> config = sysfs.hwmon_config(ts, num_sensors);
+	SensorSweep sweep(config->sensors());
+
+	auto read_sequentially = [&] () {
+		for (const unique_ptr<SensorDriver> &sensor : config->sensors())
+			sensor->read_temps();
+		ts.update();
+	};
+	auto read_sweep = [&] () {
+		sweep.read_temps();
+		ts.update();
+	};
+
+	// Both must see every change in the files
+	for (int round = 0; round < 3; ++round) {
+		write_temps(sysfs, num_sensors, round);
+		read_sweep();
+		check_temps(ts, num_sensors, round, "SensorSweep read wrong temperatures");
+		write_temps(sysfs, num_sensors, round + 10);
+		read_sequentially();
+		check_temps(ts, num_sensors, round + 10, "Sequential reads got wrong temperatures");
+	}
+
+	const unsigned int iterations = 200000 / num_sensors;
+	double sequential_us = bench::ns_per_call(iterations, read_sequentially) / 1000;
+	double sweep_us = bench::ns_per_call(iterations, read_sweep) / 1000;
+
+	std::printf("%3u hwmon sensors: SensorSweep %7.2f us, one by one %7.2f us\n",
+		num_sensors, sweep_us, sequential_us);
+}
+
+
+int main()
+{
+	// Show it when SensorSweep can't use io_uring
+	Logger::instance().log_lvl() = TF_INF;
+
+#ifdef USE_IO_URING
+	std::printf("Built with io_uring. SensorSweep uses it unless the kernel refuses.\n");
+#else
+	std::printf("Built without io_uring. SensorSweep reads sensors one by one as well.\n");
+#endif
+
+	for (unsigned int n : { 4, 16, 64 })
+		bench_sweep(n);
+
+	return 0;
+}
@@ -0,0 +1,126 @@
+/********************************************************************
+ * bench_simd_compare.cpp: Check any_greater_equal() against a scalar loop and time both
+ * (C) 2026, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+#include "bench.h"
+#include "simd_compare.h"
+#include "temperature_state.h"
+
+#include <random>
+#include <vector>
+
+using namespace thinkfan;
+
+
+// What ComplexLevel used before any_greater_equal() existed
+static bool any_greater_equal_reference(const int16_t *temps, const int16_t *limits, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+		if (temps[i] >= limits[i])
+			return true;
+	return false;
+}
+
+
+static size_t padded(size_t n)
+{ return (n + TemperatureState::lane_count - 1) / TemperatureState::lane_count * TemperatureState::lane_count; }
+
+
+// Pad like TemperatureState and ComplexLevel do, so the padding never compares true
+static void make_arrays(size_t n, std::vector<int16_t> &temps, std::vector<int16_t> &limits)
+{
+	temps.assign(padded(n), INT16_MIN);
+	limits.assign(padded(n), INT16_MAX);
+}
+
+
+static void check_equivalence()
+{
+	std::mt19937 rng(4711);
+	std::uniform_int_distribution<int> temp_dist(TemperatureState::temp_min, TemperatureState::temp_max);
+	std::uniform_int_distribution<int> near_dist(-2, 2);
+	std::vector<int16_t> temps, limits;
+	unsigned int hits = 0, checks = 0;
+
+	for (size_t n = 1; n <= 600; ++n) {
+		make_arrays(n, temps, limits);
+		for (int round = 0; round < 50; ++round) {
+			for (size_t i = 0; i < n; ++i) {
+				// Mostly close calls, some arbitrary values, and every now and then the extremes
+				temps[i] = int16_t(temp_dist(rng));
+				limits[i] = round % 5 ? int16_t(temps[i] + near_dist(rng) + 3) : int16_t(temp_dist(rng));
+				if (rng() % 97 == 0)
+					limits[i] = rng() % 2 ? INT16_MAX : int16_t(TemperatureState::temp_min);
+			}
+			// Without this, almost every round would have a hit in the first few elements
+			if (round % 2) {
+				for (size_t i = 0; i < n; ++i)
+					if (temps[i] >= limits[i])
+						temps[i] = int16_t(limits[i] - 1);
+				if (round % 4 == 1)
+					temps[rng() % n] = limits[rng() % n] = 0;
+			}
+
+			bool expected = any_greater_equal_reference(temps.data(), limits.data(), temps.size());
+			bench::check(any_greater_equal(temps.data(), limits.data(), temps.size()) == expected,
+				"any_greater_equal() differs from the scalar loop");
+			bench::check(all_less(temps.data(), limits.data(), temps.size()) == !expected,
+				"all_less() differs from the scalar loop");
+			hits += expected;
+			++checks;
+		}
+	}
+
+	std::printf("any_greater_equal() matches the scalar loop in %u cases (%u hits).\n", checks, hits);
+}
+
+
+static void time_compare(size_t n)
+{
+	std::vector<int16_t> temps, limits;
+	make_arrays(n, temps, limits);
+	for (size_t i = 0; i < n; ++i) {
+		temps[i] = int16_t(40 + i % 30);
+		limits[i] = int16_t(temps[i] + 5);
+	}
+
+	// Nothing reaches its limit, which is the common case and means both have to look at everything.
+	// The scalar loop only needs to look at the unpadded inputs.
+	const unsigned int iterations = 2000000;
+	double simd_ns = bench::ns_per_call(iterations, [&] () {
+		bench::keep(any_greater_equal(temps.data(), limits.data(), temps.size()));
+	} );
+	double scalar_ns = bench::ns_per_call(iterations, [&] () {
+		bench::keep(any_greater_equal_reference(temps.data(), limits.data(), n));
+	} );
+
+	std::printf("%4zu inputs: any_greater_equal() %7.1f ns, scalar loop %7.1f ns\n", n, simd_ns, scalar_ns);
+}
+
+
+int main()
+{
+	check_equivalence();
+
+	for (size_t n : { 8, 64, 512 })
+		time_compare(n);
+
+	return 0;
+}
@@ -0,0 +1,155 @@
+/********************************************************************
+ * aggregate.cpp: Incrementally maintained aggregates over all temperatures
+ * (C) 2026, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+#include "aggregate.h"
+#include "error.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace thinkfan {
+
+
+Aggregate::Aggregate()
+: Aggregate(MAX, {}, 1)
+{}
+
+Aggregate::Aggregate(Kind kind, const vector<float> &weights, unsigned int k)
+: kind_(kind)
+, weights_(weights)
+, k_(k)
+, sum_(0)
+, weight_sum_(0)
+{}
+
+Aggregate Aggregate::mean()
+{ return Aggregate(MEAN, {}, 1); }
+
+Aggregate Aggregate::weighted_mean(const vector<float> &weights)
+{ return Aggregate(WEIGHTED_MEAN, weights, 1); }
+
+Aggregate Aggregate::kth_largest(unsigned int k)
+{ return Aggregate(KTH_LARGEST, {}, k); }
+
+
+string Aggregate::str() const
+{
+	switch (kind_) {
+	case MAX:
+		return "maximum";
+	case MEAN:
+		return "mean";
+	case WEIGHTED_MEAN:
+		return "weighted mean";
+	case KTH_LARGEST:
+		return std::to_string(k_) + ". largest";
+	}
+	throw Bug("Invalid aggregate kind");
+}
+
+
+void Aggregate::ensure_consistency(unsigned int num_temps) const
+{
+	if (kind_ == WEIGHTED_MEAN) {
+		if (weights_.size() != num_temps)
+			throw ConfigError("Need " + std::to_string(num_temps) + " weights for the weighted mean (one for each"
+				" temperature), but got " + std::to_string(weights_.size()) + ".");
+		if (std::none_of(weights_.begin(), weights_.end(), [] (float w) { return w > 0; }))
+			throw ConfigError("At least one weight for the weighted mean must be positive.");
+		if (std::any_of(weights_.begin(), weights_.end(), [] (float w) { return w < 0; }))
+			throw ConfigError("Weights for the weighted mean must not be negative.");
+		// Weights are used with weight_frac_bits fractional bits, so anything smaller would be
+		// silently ignored (and could leave nothing to divide by).
+		if (std::any_of(weights_.begin(), weights_.end(), [] (float w) {
+			return w > 0 && std::llround(w * (1 << weight_frac_bits)) == 0;
+		}))
+			throw ConfigError("Weights for the weighted mean must be 0 or at least 1/"
+				+ std::to_string(1 << weight_frac_bits) + ".");
+	}
+	else if (kind_ == KTH_LARGEST && (k_ < 1 || k_ > num_temps))
+		throw ConfigError("Can't use the " + std::to_string(k_) + ". largest of "
+			+ std::to_string(num_temps) + " temperatures.");
+}
+
+
+void Aggregate::reset(const int16_t *temps, unsigned int num_temps)
+{
+	fixed_weights_.clear();
+	sorted_.clear();
+	sum_ = 0;
+	weight_sum_ = 0;
+
+	switch (kind_) {
+	case MAX:
+		break;
+	case MEAN:
+	case WEIGHTED_MEAN:
+		for (unsigned int i = 0; i < num_temps; ++i) {
+			int64_t w = kind_ == MEAN ? (1 << weight_frac_bits) : std::llround(weights_[i] * (1 << weight_frac_bits));
+			fixed_weights_.push_back(w);
+			weight_sum_ += w;
+			sum_ += w * temps[i];
+		}
+		break;
+	case KTH_LARGEST:
+		sorted_.assign(temps, temps + num_temps);
+		std::sort(sorted_.begin(), sorted_.end());
+		break;
+	}
+}
+
+
+void Aggregate::replace(unsigned int idx, int old_temp, int new_temp)
+{
+	if (kind_ == MEAN || kind_ == WEIGHTED_MEAN)
+		sum_ += fixed_weights_[idx] * (new_temp - old_temp);
+	else if (kind_ == KTH_LARGEST) {
+		// Move the changed value to its new position, shifting everything in between by one
+		size_t pos = size_t(std::lower_bound(sorted_.begin(), sorted_.end(), old_temp) - sorted_.begin());
+		if (new_temp > old_temp) {
+			for (; pos + 1 < sorted_.size() && sorted_[pos + 1] < new_temp; ++pos)
+				sorted_[pos] = sorted_[pos + 1];
+		}
+		else {
+			for (; pos > 0 && sorted_[pos - 1] > new_temp; --pos)
+				sorted_[pos] = sorted_[pos - 1];
+		}
+		sorted_[pos] = int16_t(new_temp);
+	}
+}
+
+
+int Aggregate::value() const
+{
+	switch (kind_) {
+	case MEAN:
+	case WEIGHTED_MEAN:
+		return int(std::lround(double(sum_) / double(weight_sum_)));
+	case KTH_LARGEST:
+		return sorted_[sorted_.size() - k_];
+	case MAX:
+		break;
+	}
+	throw Bug("The maximum is not maintained by Aggregate");
+}
+
+
+} // namespace thinkfan
@@ -0,0 +1,81 @@
+#pragma once
+
+/********************************************************************
+ * aggregate.h: Incrementally maintained aggregates over all temperatures
+ * (C) 2026, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+#include "thinkfan.h"
+
+#include <cstdint>
+
+namespace thinkfan {
+
+
+/** @brief A single value computed from all (biased) temperatures, which is what levels with a
+ *  single limit are compared against. The default is the maximum, which the TemperatureState
+ *  computes anyway (cf. TemperatureState::tmax()), so it isn't maintained here.
+ *  All others are kept up to date by replace() for each temperature that changes, so value() is
+ *  O(1):
+ *  - MEAN and WEIGHTED_MEAN keep a (weighted) sum in fixed point.
+ *  - KTH_LARGEST keeps a sorted copy of the temperatures, in which a changed temperature is moved
+ *    to its new position. */
+class Aggregate {
+public:
+	enum Kind { MAX, MEAN, WEIGHTED_MEAN, KTH_LARGEST };
+
+	Aggregate();
+	static Aggregate mean();
+	static Aggregate weighted_mean(const vector<float> &weights);
+	static Aggregate kth_largest(unsigned int k);
+
+	Kind kind() const { return kind_; }
+	const vector<float> &weights() const { return weights_; }
+	unsigned int k() const { return k_; }
+	string str() const;
+
+	/// @brief Throw a ConfigError if this can't work with @a num_temps temperatures.
+	void ensure_consistency(unsigned int num_temps) const;
+
+	/// @brief Recompute everything from @a num_temps @a temps.
+	void reset(const int16_t *temps, unsigned int num_temps);
+
+	/// @brief Temperature @a idx has changed from @a old_temp to @a new_temp.
+	void replace(unsigned int idx, int old_temp, int new_temp);
+
+	int value() const;
+
+private:
+	Aggregate(Kind kind, const vector<float> &weights, unsigned int k);
+
+	// Weights are kept in fixed point with this many fractional bits
+	static constexpr unsigned int weight_frac_bits = 8;
+
+	Kind kind_;
+	vector<float> weights_;
+	unsigned int k_;
+
+	vector<int64_t> fixed_weights_;
+	int64_t sum_;
+	int64_t weight_sum_;
+	vector<int16_t> sorted_;
+};
+
+
+} // namespace thinkfan
@@ -26,8 +26,10 @@
 #include <cstring>
 #include <cerrno>
 #include <numeric>
+#include <cmath>
 #include "parser.h"
 #include "message.h"
+#include "simd_compare.h"
 #include "thinkfan.h"
 
 #ifdef USE_YAML
@@ -39,6 +41,9 @@ namespace thinkfan {
 
 FanConfig::FanConfig(unique_ptr<FanDriver> &&fan_drv)
 : fan_(std::move(fan_drv))
+, stable_generation_(0)
+, evaluations_(0)
+, skipped_evaluations_(0)
 {}
 
 const unique_ptr<FanDriver> &FanConfig::fan() const
@@ -48,41 +53,195 @@ void FanConfig::set_fan(unique_ptr<FanDriver> &&fan)
 { fan_ = std::move(fan); }
 
 
+bool FanConfig::unchanged(const TemperatureState &ts)
+{
+	if (ts.generation() == stable_generation_) {
+		++skipped_evaluations_;
+		return true;
+	}
+	++evaluations_;
+	return false;
+}
+
+void FanConfig::set_stable(const TemperatureState &ts)
+{ stable_generation_ = ts.generation(); }
+
+void FanConfig::reset_stable()
+{ stable_generation_ = 0; }
+
+
 
 StepwiseMapping::StepwiseMapping(unique_ptr<FanDriver> &&fan_drv)
 : FanConfig(std::move(fan_drv))
+, cur_lvl_(0)
+, stride_(0)
+, lut_min_(0)
+, lut_width_(0)
 {}
 
 const vector<unique_ptr<Level>> &StepwiseMapping::levels() const
 { return levels_; }
 
+const Level &StepwiseMapping::cur_level() const
+{ return *levels_[cur_lvl_]; }
+
+
+static int16_t limit16(int limit)
+{ return int16_t(std::clamp<int>(limit, numeric_limits<int16_t>::min(), numeric_limits<int16_t>::max())); }
+
+
+/** @brief Find the next level, starting at @a cur: Go up as long as @a up(level) says so, otherwise
+ *  go down as long as @a down(level) says so. */
+template<class UpFnT, class DownFnT>
+static size_t walk_levels(size_t cur, size_t top, UpFnT &&up, DownFnT &&down)
+{
+	if (cur != top && up(cur)) {
+		while (cur != top && up(cur))
+			cur++;
+	}
+	else {
+		while (cur != 0 && down(cur))
+			cur--;
+	}
+	return cur;
+}
+
+
+void StepwiseMapping::compile_levels(const TemperatureState &ts)
+{
+	lower_limits_.clear();
+	upper_limits_.clear();
+
+	lut_.clear();
+
+	if (levels_.front()->upper_limit().size() == 1) {
+		stride_ = 0;
+		for (const unique_ptr<Level> &lvl : levels_) {
+			lower_limits_.push_back(limit16(lvl->lower_limit().front()));
+			upper_limits_.push_back(limit16(lvl->upper_limit().front()));
+		}
+		compile_lookup_table();
+		return;
+	}
+
+	if (levels_.front()->upper_limit().size() != ts.size())
+		throw Bug("Level limits don't match the number of temperatures");
+
+	// The padding in the biased temperatures is INT16_MIN, so a padding of INT16_MAX makes sure
+	// it's always below the limit.
+	stride_ = ts.padded_size();
+	lower_limits_.resize(levels_.size() * stride_, numeric_limits<int16_t>::max());
+	upper_limits_.resize(levels_.size() * stride_, numeric_limits<int16_t>::max());
+
+	for (size_t row = 0; row < levels_.size(); ++row) {
+		std::transform(levels_[row]->lower_limit().begin(), levels_[row]->lower_limit().end(),
+			lower_limits_.begin() + ptrdiff_t(row * stride_), limit16);
+		std::transform(levels_[row]->upper_limit().begin(), levels_[row]->upper_limit().end(),
+			upper_limits_.begin() + ptrdiff_t(row * stride_), limit16);
+	}
+}
+
+
+void StepwiseMapping::compile_lookup_table()
+{
+	// Temperatures are clamped to [temp_min, temp_max], so limits outside of that range compare the
+	// same for every temperature. Within the range, all temperatures below the lowest limit behave
+	// the same, and so do all temperatures at or above the highest limit.
+	int lo = numeric_limits<int>::max();
+	int hi = numeric_limits<int>::min();
+	for (const vector<int16_t> *limits : { &lower_limits_, &upper_limits_ }) {
+		for (int limit : *limits) {
+			if (limit >= TemperatureState::temp_min && limit <= TemperatureState::temp_max) {
+				lo = std::min(lo, limit);
+				hi = std::max(hi, limit);
+			}
+		}
+	}
+	if (lo > hi)
+		lo = hi = 0;
+
+	lut_min_ = lo - 1;
+	lut_width_ = hi - lut_min_ + 1;
+	if (lut_width_ > max_lut_width) {
+		log(TF_DBG) << "Fan levels span " << lut_width_ << " degrees, not using a lookup table." << flush;
+		return;
+	}
+
+	const size_t top = levels_.size() - 1;
+	lut_.resize(levels_.size() * size_t(lut_width_));
+	for (size_t cur = 0; cur < levels_.size(); ++cur) {
+		for (int col = 0; col < lut_width_; ++col) {
+			const int t = lut_min_ + col;
+			lut_[cur * size_t(lut_width_) + size_t(col)] = uint16_t(walk_levels(cur, top,
+				[&] (size_t l) { return t >= upper_limits_[l]; },
+				[&] (size_t l) { return t < lower_limits_[l]; }
+			));
+		}
+	}
+}
+
+
+bool StepwiseMapping::up(size_t level, const TemperatureState &ts) const
+{
+	if (stride_ == 0)
+		return ts.aggregate() >= upper_limits_[level];
+	return any_greater_equal(ts.biased_temps(), &upper_limits_[level * stride_], stride_);
+}
+
+
+bool StepwiseMapping::down(size_t level, const TemperatureState &ts) const
+{
+	if (stride_ == 0)
+		return ts.aggregate() < lower_limits_[level];
+	return all_less(ts.biased_temps(), &lower_limits_[level * stride_], stride_);
+}
+
+
+size_t StepwiseMapping::next_level(const TemperatureState &ts) const
+{
+	if (!lut_.empty()) {
+		const int col = std::clamp(ts.aggregate(), lut_min_, lut_min_ + lut_width_ - 1) - lut_min_;
+		return lut_[cur_lvl_ * size_t(lut_width_) + size_t(col)];
+	}
+
+	return walk_levels(cur_lvl_, levels_.size() - 1,
+		[&] (size_t l) { return up(l, ts); },
+		[&] (size_t l) { return down(l, ts); }
+	);
+}
+
+
 void StepwiseMapping::init_fanspeed(const TemperatureState &ts)
 {
-	cur_lvl_ = --levels().end();
-	while (cur_lvl_ != levels().begin() && (*cur_lvl_)->down(ts))
-		cur_lvl_--;
-	fan()->set_speed(**cur_lvl_);
+	compile_levels(ts);
+
+	// Starting at the top, this can only go down
+	cur_lvl_ = levels_.size() - 1;
+	cur_lvl_ = next_level(ts);
+	reset_stable();
+	fan()->set_speed(cur_level());
 }
 
 bool StepwiseMapping::set_fanspeed(const TemperatureState &ts)
 {
-	if (unlikely(cur_lvl_ != --levels().end() && (*cur_lvl_)->up(ts))) {
-		while (cur_lvl_ != --levels().end() && (*cur_lvl_)->up(ts))
-			cur_lvl_++;
-		fan()->set_speed(**cur_lvl_);
-		return true;
-	}
-	else if (unlikely(cur_lvl_ != levels().begin() && (*cur_lvl_)->down(ts))) {
-		while (cur_lvl_ != levels().begin() && (*cur_lvl_)->down(ts))
-			cur_lvl_--;
-		fan()->set_speed(**cur_lvl_);
-		tmp_sleeptime = sleeptime;
-		return true;
+	if (likely(unchanged(ts))) {
+		fan()->ping_watchdog_and_depulse(cur_level());
+		return false;
 	}
-	else {
-		fan()->ping_watchdog_and_depulse(**cur_lvl_);
+
+	const size_t next = next_level(ts);
+
+	if (likely(next == cur_lvl_)) {
+		set_stable(ts);
+		fan()->ping_watchdog_and_depulse(cur_level());
 		return false;
 	}
+
+	if (next < cur_lvl_)
+		tmp_sleeptime = sleeptime;
+	cur_lvl_ = next;
+	fan()->set_speed(cur_level());
+	return true;
 }
 
 
@@ -108,6 +267,197 @@ void StepwiseMapping::ensure_consistency(const Config &config) const
 }
 
 
+PidMapping::PidMapping(unique_ptr<FanDriver> &&fan_drv, const Params &params)
+: FanConfig(std::move(fan_drv))
+, params_(params)
+, integral_(0)
+, prev_error_(0)
+, cur_output_(-1)
+{}
+
+
+void PidMapping::init_fanspeed(const TemperatureState &ts)
+{
+	integral_ = 0;
+	prev_error_ = float(ts.aggregate()) - params_.setpoint;
+	last_update_ = std::chrono::steady_clock::now();
+	cur_output_ = -1;
+	write_output(compute(ts, 0));
+}
+
+
+bool PidMapping::set_fanspeed(const TemperatureState &ts)
+{
+	const auto now = std::chrono::steady_clock::now();
+	const float dt = std::chrono::duration<float>(now - last_update_).count();
+	last_update_ = now;
+
+	// The output changes a little in most cycles, which is nothing to notify about.
+	if (write_output(compute(ts, dt)))
+		log(TF_DBG) << fan()->path() << ": PID output " << cur_output_ << flush;
+	return false;
+}
+
+
+int PidMapping::compute(const TemperatureState &ts, float dt)
+{
+	const float error = float(ts.aggregate()) - params_.setpoint;
+	const float derivative = dt > 0 ? (error - prev_error_) / dt : 0;
+	prev_error_ = error;
+
+	const float lo = float(params_.min_output);
+	const float hi = float(params_.max_output);
+
+	float integral = std::clamp(integral_ + params_.ki * error * dt, lo - hi, hi - lo);
+	float output = params_.kp * error + integral + params_.kd * derivative;
+
+	// Anti-windup: Don't integrate any further while the output is saturated in the direction
+	// the error is pushing it.
+	if ((output > hi && error > 0) || (output < lo && error < 0))
+		output -= integral - integral_;
+	else
+		integral_ = integral;
+
+	return int(std::lround(std::clamp(output, lo, hi)));
+}
+
+
+bool PidMapping::write_output(int output)
+{
+	const bool at_limit = output == params_.min_output || output == params_.max_output;
+	if (cur_output_ >= 0 && (output == cur_output_
+			|| (unsigned(std::abs(output - cur_output_)) < params_.min_delta && !at_limit)))
+		return false;
+
+	static_cast<HwmonFanDriver &>(*fan()).set_pwm(output);
+	cur_output_ = output;
+	return true;
+}
+
+
+void PidMapping::ensure_consistency(const Config &) const
+{
+	if (!fan())
+		throw ConfigError("No fan specified in PID mapping.");
+
+	if (!dynamic_cast<const HwmonFanDriver *>(fan().get()))
+		throw ConfigError("A PID controller can only drive a hwmon fan.");
+
+	if (params_.min_output < 0 || params_.max_output > 255 || params_.min_output >= params_.max_output)
+		throw ConfigError("PID output limits must satisfy 0 <= min_output < max_output <= 255.");
+
+	if (params_.kp < 0 || params_.ki < 0 || params_.kd < 0)
+		throw ConfigError("PID gains must not be negative.");
+
+	if (params_.min_delta < 1)
+		throw ConfigError("The minimum PID output delta must be at least 1.");
+
+	// A PID controller reacts to every change in temperature, so there is no fan level limit that a
+	// temperature alarm could be set to.
+	if (event_wakeups)
+		throw ConfigError("A PID controller can't be used with event wakeups (-e).");
+}
+
+
+CurveMapping::CurveMapping(unique_ptr<FanDriver> &&fan_drv, const vector<pair<int, int>> &points, unsigned int hysteresis)
+: FanConfig(std::move(fan_drv))
+, points_(points)
+, hysteresis_(hysteresis)
+, table_min_(0)
+, cur_output_(-1)
+{}
+
+
+void CurveMapping::compile_table()
+{
+	table_.clear();
+	table_min_ = points_.front().first;
+
+	for (size_t i = 0; i + 1 < points_.size(); ++i) {
+		const auto &[t0, p0] = points_[i];
+		const auto &[t1, p1] = points_[i + 1];
+		for (int t = t0; t < t1; ++t)
+			table_.push_back(uint8_t(std::lround(p0 + double(p1 - p0) * (t - t0) / (t1 - t0))));
+	}
+	table_.push_back(uint8_t(points_.back().second));
+}
+
+
+int CurveMapping::lookup(int temp) const
+{ return table_[size_t(std::clamp(temp - table_min_, 0, int(table_.size()) - 1))]; }
+
+
+opt<int> CurveMapping::upper_limit() const
+{
+	for (size_t i = 0; i < table_.size(); ++i)
+		if (table_[i] > cur_output_)
+			return table_min_ + int(i);
+	return nullopt;
+}
+
+
+void CurveMapping::init_fanspeed(const TemperatureState &ts)
+{
+	compile_table();
+	reset_stable();
+
+	cur_output_ = lookup(ts.aggregate());
+	static_cast<HwmonFanDriver &>(*fan()).set_pwm(cur_output_);
+}
+
+
+bool CurveMapping::set_fanspeed(const TemperatureState &ts)
+{
+	if (likely(unchanged(ts)))
+		return false;
+
+	const int temp = ts.aggregate();
+	int output = lookup(temp);
+	if (output < cur_output_)
+		// Going down: Use the curve shifted by the hysteresis
+		output = std::min(lookup(temp + int(hysteresis_)), cur_output_);
+
+	if (likely(output == cur_output_)) {
+		set_stable(ts);
+		return false;
+	}
+
+	if (output < cur_output_)
+		tmp_sleeptime = sleeptime;
+	cur_output_ = output;
+	static_cast<HwmonFanDriver &>(*fan()).set_pwm(cur_output_);
+	return true;
+}
+
+
+void CurveMapping::ensure_consistency(const Config &) const
+{
+	if (!fan())
+		throw ConfigError("No fan specified in curve mapping.");
+
+	if (!dynamic_cast<const HwmonFanDriver *>(fan().get()))
+		throw ConfigError("A fan curve can only drive a hwmon fan.");
+
+	if (points_.size() < 2)
+		throw ConfigError("A fan curve needs at least two points.");
+
+	for (size_t i = 0; i < points_.size(); ++i) {
+		const auto &[temp, pwm] = points_[i];
+		if (temp < TemperatureState::temp_min || temp > TemperatureState::temp_max)
+			throw ConfigError("Invalid temperature in fan curve: " + std::to_string(temp));
+		if (pwm < 0 || pwm > 255)
+			throw ConfigError("Fan curve PWM values must be between 0 and 255.");
+		if (i > 0 && temp <= points_[i - 1].first)
+			throw ConfigError("Fan curve temperatures must be strictly increasing.");
+		if (i > 0 && pwm < points_[i - 1].second)
+			throw ConfigError("Fan curve PWM values must not decrease with rising temperature.");
+	}
+
+	if (hysteresis_ > unsigned(points_.back().first - points_.front().first))
+		throw ConfigError("The fan curve hysteresis must not exceed the temperature range of the curve.");
+}
+
+
 void StepwiseMapping::add_level(unique_ptr<Level> &&level)
 {
 	if (levels_.size() > 0) {
@@ -243,6 +593,13 @@ void Config::ensure_consistency() const
 
 	if (sensors().size() < 1)
 		throw ConfigError(src_file + ": " + MSG_NO_SENSOR);
+
+	try {
+		aggregate_.ensure_consistency(num_temps());
+	} catch (ConfigError &err) {
+		err.set_filename(src_file);
+		throw;
+	}
 }
 
 
@@ -250,6 +607,12 @@ void Config::ensure_consistency() const
 void Config::add_sensor(unique_ptr<SensorDriver> &&sensor)
 { sensors_.push_back(std::move(sensor)); }
 
+void Config::set_aggregate(const Aggregate &aggregate)
+{ aggregate_ = aggregate; }
+
+const Aggregate &Config::aggregate() const
+{ return aggregate_; }
+
 
 unsigned int Config::num_temps() const
 {
@@ -299,6 +662,7 @@ void Config::init(TemperatureState &ts) const
 	init_fans();
 	ensure_consistency();
 	init_temperature_refs(ts);
+	ts.set_aggregate(aggregate());
 }
 
 
@@ -326,6 +690,7 @@ Level::Level(string level, int lower_limit, int upper_limit)
 Level::Level(int level, const vector<int> &lower_limit, const vector<int> &upper_limit)
 : level_s_("level " + std::to_string(level)),
   level_n_(level),
+  num_s_(std::to_string(level_n_)),
   lower_limit_(lower_limit),
   upper_limit_(upper_limit)
 {}
@@ -333,6 +698,7 @@ Level::Level(int level, const vector<int> &lower_limit, const vector<int> &upper
 Level::Level(string level, const vector<int> &lower_limit, const vector<int> &upper_limit)
 : level_s_(level),
   level_n_(string_to_int(level_s_)),
+  num_s_(std::to_string(level_n_)),
   lower_limit_(lower_limit),
   upper_limit_(upper_limit)
 {
@@ -376,6 +742,9 @@ const string &Level::str() const
 int Level::num() const
 { return this->level_n_; }
 
+const string &Level::num_str() const
+{ return this->num_s_; }
+
 
 
 SimpleLevel::SimpleLevel(int level, int lower_limit, int upper_limit)
@@ -386,12 +755,6 @@ SimpleLevel::SimpleLevel(string level, int lower_limit, int upper_limit)
 : Level(level, lower_limit, upper_limit)
 {}
 
-bool SimpleLevel::up(const TemperatureState &temp_state) const
-{ return *temp_state.tmax >= upper_limit().front(); }
-
-bool SimpleLevel::down(const TemperatureState &temp_state) const
-{ return *temp_state.tmax < lower_limit().front(); }
-
 void SimpleLevel::ensure_consistency(const Config &) const
 {}
 
@@ -407,32 +770,6 @@ ComplexLevel::ComplexLevel(string level, const vector<int> &lower_limit, const v
 {}
 
 
-bool ComplexLevel::up(const TemperatureState &temp_state) const
-{
-	vector<int>::const_iterator temp_it = temp_state.biased_temps().begin();
-	auto upper_it = upper_limit().begin();
-
-	while (temp_it != temp_state.biased_temps().end())
-		if (*temp_it++ >= *upper_it++) return true;
-
-	return false;
-}
-
-
-bool ComplexLevel::down(const TemperatureState &temp_state) const
-{
-	auto temp_it = temp_state.biased_temps().begin();
-	auto lower_it = lower_limit().begin();
-
-	while (temp_it != temp_state.biased_temps().end() && *temp_it < *lower_it) {
-		temp_it++;
-		lower_it++;
-	}
-
-	return temp_it == temp_state.biased_temps().end();
-}
-
-
 void ComplexLevel::ensure_consistency(const Config &cfg) const
 {
 	string limitstr;
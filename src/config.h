@@ -40,11 +40,39 @@ public:
 	void set_fan(unique_ptr<FanDriver> &&);
 	const unique_ptr<FanDriver> &fan() const;
 
+	/// @return How often set_fanspeed() has looked at the temperatures
+	unsigned int evaluations() const { return evaluations_; }
+	/// @return How often set_fanspeed() didn't need to look at the temperatures
+	unsigned int skipped_evaluations() const { return skipped_evaluations_; }
+
+protected:
+	/// @brief Count one call to set_fanspeed().
+	/// @return Whether the biased temperatures in @a ts are still the ones that were last passed
+	/// to set_stable(), i.e. evaluating them again would not change anything.
+	bool unchanged(const TemperatureState &ts);
+
+	/// @brief Evaluating @a ts has left the fan speed as it was.
+	void set_stable(const TemperatureState &ts);
+
+	/// @brief Make the next unchanged() return false.
+	void reset_stable();
+
 private:
 	unique_ptr<FanDriver> fan_;
+	uint64_t stable_generation_;
+	unsigned int evaluations_;
+	unsigned int skipped_evaluations_;
 };
 
 
+/** @brief Maps temperatures to fan levels with a list of Level objects, each with a lower and an
+ *  upper limit. When the fan speed is initialized, the limits of all levels are compiled into two
+ *  row-major matrices (one row per level, one column per temperature, padded like the arrays in the
+ *  TemperatureState), which are all that set_fanspeed() looks at. The Level objects remain for
+ *  introspection and logging.
+ *  If each level has only a single limit (compared against TemperatureState::aggregate(), i.e. the
+ *  maximum temperature by default), the whole mapping is instead compiled into a lookup table that
+ *  gives the next level for every combination of current level and (clamped) aggregate. */
 class StepwiseMapping : public FanConfig {
 public:
 	StepwiseMapping(unique_ptr<FanDriver> && = nullptr);
@@ -54,10 +82,110 @@ public:
 	virtual void ensure_consistency(const Config &) const override;
 	void add_level(unique_ptr<Level> &&level);
 	const vector<unique_ptr<Level>> &levels() const;
+	const Level &cur_level() const;
 
 private:
+	// bench/bench_lookup_table.cpp checks the lookup table against the level walk
+	friend class StepwiseMappingCheck;
+
+	void compile_levels(const TemperatureState &ts);
+	void compile_lookup_table();
+	bool up(size_t level, const TemperatureState &ts) const;
+	bool down(size_t level, const TemperatureState &ts) const;
+
+	/// @return The level to switch to from cur_lvl_, which may be cur_lvl_ itself
+	size_t next_level(const TemperatureState &ts) const;
+
 	vector<unique_ptr<Level>> levels_;
-	vector<unique_ptr<Level>>::const_iterator cur_lvl_;
+	size_t cur_lvl_;
+
+	// Number of columns in lower_limits_ and upper_limits_. Zero if the levels have a single limit
+	// each, which is compared against the aggregate temperature.
+	size_t stride_;
+	vector<int16_t> lower_limits_;
+	vector<int16_t> upper_limits_;
+
+	// Only if stride_ == 0: The next level for each current level (row) and aggregate temperature
+	// (column, starting at lut_min_). Empty if the limits span too many degrees.
+	static constexpr int max_lut_width = 1024;
+	vector<uint16_t> lut_;
+	int lut_min_;
+	int lut_width_;
+};
+
+
+/** @brief Continuously computes a PWM value for a hwmon fan from TemperatureState::aggregate()
+ *  with a PID controller, instead of switching between discrete levels.
+ *  The integral is only accumulated while the output isn't saturated in the direction of the
+ *  error (anti-windup). The fan is only written when the output has moved by at least
+ *  @a min_delta, or when it has reached one of the output limits. */
+class PidMapping : public FanConfig {
+public:
+	struct Params {
+		float setpoint;
+		float kp;
+		float ki;
+		float kd;
+		int min_output;
+		int max_output;
+		unsigned int min_delta;
+	};
+
+	PidMapping(unique_ptr<FanDriver> &&fan_drv, const Params &params);
+	virtual ~PidMapping() override = default;
+	virtual void init_fanspeed(const TemperatureState &) override;
+	virtual bool set_fanspeed(const TemperatureState &) override;
+	virtual void ensure_consistency(const Config &) const override;
+
+	const Params &params() const { return params_; }
+
+private:
+	// bench/bench_fan_mappings.cpp steps the controller with a fixed dt
+	friend class PidMappingCheck;
+
+	/// @return The new output for the temperature in @a ts after @a dt seconds
+	int compute(const TemperatureState &ts, float dt);
+	bool write_output(int output);
+
+	const Params params_;
+	float integral_;
+	float prev_error_;
+	std::chrono::steady_clock::time_point last_update_;
+	int cur_output_;
+};
+
+
+/** @brief Maps TemperatureState::aggregate() to a PWM value for a hwmon fan by linear
+ *  interpolation between (temperature, PWM) points.
+ *  When the fan speed is initialized, the curve is compiled into a table with one PWM value per
+ *  degree between the first and the last point, so each cycle is just a clamp and a lookup.
+ *  With a @a hysteresis, the output only goes down once the temperature has dropped that many
+ *  degrees below where the curve would give the current output. */
+class CurveMapping : public FanConfig {
+public:
+	CurveMapping(unique_ptr<FanDriver> &&fan_drv, const vector<pair<int, int>> &points, unsigned int hysteresis);
+	virtual ~CurveMapping() override = default;
+	virtual void init_fanspeed(const TemperatureState &) override;
+	virtual bool set_fanspeed(const TemperatureState &) override;
+	virtual void ensure_consistency(const Config &) const override;
+
+	const vector<pair<int, int>> &points() const { return points_; }
+
+	/// @return The lowest temperature at which the output rises above the current one, nothing if
+	/// it is already at the end of the curve
+	opt<int> upper_limit() const;
+
+private:
+	void compile_table();
+	int lookup(int temp) const;
+
+	const vector<pair<int, int>> points_;
+	const unsigned int hysteresis_;
+
+	// One PWM value per degree, starting at the temperature of the first point
+	vector<uint8_t> table_;
+	int table_min_;
+	int cur_output_;
 };
 
 
@@ -65,6 +193,8 @@ class Level {
 protected:
 	string level_s_;
 	int level_n_;
+	// Pre-rendered level_n_ for writing to a PWM file
+	string num_s_;
 	vector<int> lower_limit_;
 	vector<int> upper_limit_;
 public:
@@ -78,13 +208,11 @@ public:
 	const vector<int> &lower_limit() const;
 	const vector<int> &upper_limit() const;
 
-	virtual bool up(const TemperatureState &) const = 0;
-	virtual bool down(const TemperatureState &) const = 0;
-
 	virtual void ensure_consistency(const Config &) const = 0;
 
 	const string &str() const;
 	int num() const;
+	const string &num_str() const;
 
 	static int string_to_int(string &level);
 };
@@ -95,8 +223,6 @@ class SimpleLevel : public Level {
 public:
 	SimpleLevel(int level, int lower_limit, int upper_limit);
 	SimpleLevel(string level, int lower_limit, int upper_limit);
-	virtual bool up(const TemperatureState &) const override;
-	virtual bool down(const TemperatureState &) const override;
 	virtual void ensure_consistency(const Config &) const override;
 };
 
@@ -105,8 +231,6 @@ class ComplexLevel : public Level {
 public:
 	ComplexLevel(int level, const vector<int> &lower_limit, const vector<int> &upper_limit);
 	ComplexLevel(string level, const vector<int> &lower_limit, const vector<int> &upper_limit);
-	virtual bool up(const TemperatureState &) const override;
-	virtual bool down(const TemperatureState &) const override;
 	virtual void ensure_consistency(const Config &) const override;
 
 private:
@@ -122,6 +246,7 @@ public:
 	static const Config *read_config(const vector<string> &filenames);
 	void add_sensor(unique_ptr<SensorDriver> &&sensor);
 	void add_fan_config(unique_ptr<FanConfig> &&fan_cfg);
+	void set_aggregate(const Aggregate &aggregate);
 	void ensure_consistency() const;
 	void init_fans() const;
 	TemperatureState init_sensors() const;
@@ -131,6 +256,8 @@ public:
 	unsigned int num_temps() const;
 	const vector<unique_ptr<SensorDriver>> &sensors() const;
 	const vector<unique_ptr<FanConfig>> &fan_configs() const;
+	/// @return What levels with a single limit are compared against
+	const Aggregate &aggregate() const;
 
 	string src_file;
 private:
@@ -138,6 +265,7 @@ private:
 	void try_init_driver(Driver &drv) const;
 	vector<unique_ptr<SensorDriver>> sensors_;
 	vector<unique_ptr<FanConfig>> temp_mappings_;
+	Aggregate aggregate_;
 };
 
 
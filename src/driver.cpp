@@ -40,8 +40,9 @@ void Driver::try_init()
 				path_.emplace(lookup());
 			init();
 			initialized_ = true;
+			return IOStatus();
 		},
-		[&]/* skip_fn */(const ExpectedError &e) {
+		[&]/* skip_fn */(const IOStatus &e) {
 			log(optional() ? TF_DBG : TF_INF) << "Ignoring error ";
 			if (max_errors() && !optional())
 				log() << errors() << "/" << max_errors() << " ";
@@ -51,31 +52,34 @@ void Driver::try_init()
 }
 
 
-void Driver::robust_op(FN<void ()> op_fn, FN<void (const ExpectedError &)> skip_fn)
+bool Driver::error_tolerated() const
+{ return optional() || tolerate_errors || errors() < max_errors() || !chk_sanity; }
+
+
+IOStatus Driver::handle_io_error_()
 {
 	try {
-		errors_++;
-		op_fn();
-		errors_ = 0;
+		throw;
 	} catch (DriverInitError &e) {
 		e.set_context(type_name());
-		handle_io_error_(e, skip_fn);
+		if (!error_tolerated())
+			throw;
+		return e;
 	} catch (SystemError &e) {
-		handle_io_error_(e, skip_fn);
+		if (!error_tolerated())
+			throw;
+		return e;
 	} catch (IOerror &e) {
-		handle_io_error_(e, skip_fn);
+		if (!error_tolerated())
+			throw;
+		return e;
 	} catch (std::ios_base::failure &e) {
-		handle_io_error_(IOerror(e.what(), THINKFAN_IO_ERROR_CODE(e)), skip_fn);
+		IOerror err(e.what(), THINKFAN_IO_ERROR_CODE(e));
+		if (!error_tolerated())
+			throw err;
+		return err;
 	}
-}
-
-
-void Driver::handle_io_error_(const ExpectedError &e, FN<void (const ExpectedError &)> skip_fn)
-{
-	if (optional() || tolerate_errors || errors() < max_errors() || !chk_sanity)
-		skip_fn(e);
-	else
-		throw e;
+	// Anything else just propagates
 }
 
 
@@ -97,7 +101,7 @@ bool Driver::initialized() const
 bool Driver::available() const
 { return path_.has_value(); }
 
-void Driver::skip_io_error(const ExpectedError &e)
+void Driver::skip_io_error(const IOStatus &e)
 { log(TF_ERR) << e.what() << flush; }
 
 
@@ -23,7 +23,6 @@
 
 #include "thinkfan.h"
 #include "error.h"
-#include <functional>
 
 namespace thinkfan {
 
@@ -35,9 +34,6 @@ protected:
 	virtual ~Driver() noexcept(false)
 	{}
 
-	template<typename FnSignatureT>
-	using FN = std::function<FnSignatureT>;
-
 public:
 	void try_init();
 	unsigned int errors() const;
@@ -48,10 +44,17 @@ public:
 	 *  will result in an exception. */
 	const string &path() const;
 
-	void robust_op(FN<void ()> op_fn, FN<void (const ExpectedError &)> skip_fn);
+	/** @brief Run @a op_fn and handle its errors according to optional()/max_errors().
+	 *  Errors can either be returned as an IOStatus, which is the normal way for runtime I/O, or
+	 *  thrown as an ExpectedError (e.g. by init()). If an error is tolerated, @a skip_fn is called,
+	 *  otherwise it is (re-)thrown.
+	 *  @param op_fn Callable that takes no arguments and returns an IOStatus
+	 *  @param skip_fn Callable that takes a const IOStatus & */
+	template<class OpFnT, class SkipFnT>
+	void robust_op(OpFnT &&op_fn, SkipFnT &&skip_fn);
 
 	template<class DriverT, typename... ArgTs>
-	void robust_io(void (DriverT::*io_func)(ArgTs...), ArgTs &&... args);
+	void robust_io(IOStatus (DriverT::*io_func)(ArgTs...), ArgTs &&... args);
 
 	bool initialized() const;
 	bool available() const;
@@ -62,7 +65,11 @@ private:
 	bool optional_;
 	bool initialized_;
 
-	void handle_io_error_(const ExpectedError &e, FN<void (const ExpectedError &)> skip_fn);
+	bool error_tolerated() const;
+
+	/** @brief Must be called from a catch block in robust_op().
+	 *  @return The caught error as an IOStatus if it is tolerated, otherwise rethrow it. */
+	IOStatus handle_io_error_();
 
 protected:
 	virtual void init() = 0;
@@ -77,28 +84,49 @@ protected:
 	/// @return A user-friendly name for the type of driver represented by the implementor
 	virtual string type_name() const = 0;
 
-	virtual void skip_io_error(const ExpectedError &);
+	virtual void skip_io_error(const IOStatus &);
 
 	opt<const string> path_;
 };
 
 
-template<class DriverT, typename... ArgTs>
-void Driver::robust_io(void (DriverT::*io_func)(ArgTs...), ArgTs &&... args)
+template<class OpFnT, class SkipFnT>
+void Driver::robust_op(OpFnT &&op_fn, SkipFnT &&skip_fn)
 {
-	using namespace std::placeholders;
+	IOStatus status;
+
+	try {
+		errors_++;
+		status = op_fn();
+	} catch (...) {
+		status = handle_io_error_();
+	}
+
+	if (likely(status.ok()))
+		errors_ = 0;
+	else if (error_tolerated())
+		skip_fn(status);
+	else
+		status.raise();
+}
 
+
+template<class DriverT, typename... ArgTs>
+void Driver::robust_io(IOStatus (DriverT::*io_func)(ArgTs...), ArgTs &&... args)
+{
 	if (!available() || !initialized())
 		try_init();
 
 	if (initialized())
 		robust_op(
 			[&] () {
-				(static_cast<DriverT *>(this)->*io_func)(
+				return (static_cast<DriverT *>(this)->*io_func)(
 					std::forward<ArgTs>(args)...
 				);
 			},
-			std::bind(&Driver::skip_io_error, this, _1)
+			[this] (const IOStatus &e) {
+				skip_io_error(e);
+			}
 		);
 }
 
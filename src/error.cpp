@@ -40,12 +40,21 @@
 namespace thinkfan {
 
 
-static string make_backtrace()
+static int capture_backtrace(void **bt_buffer)
+{
+#if defined(__GLIBC__)
+	return ::backtrace(bt_buffer, MAX_BACKTRACE_DEPTH);
+#else
+	(void)bt_buffer;
+	return 0;
+#endif
+}
+
+
+static string symbolize_backtrace(void *const *bt_buffer, int stack_depth)
 {
 #if defined(__GLIBC__)
 	string backtrace_;
-	void *bt_buffer[MAX_BACKTRACE_DEPTH];
-	int stack_depth = ::backtrace(bt_buffer, MAX_BACKTRACE_DEPTH);
 	if (stack_depth == MAX_BACKTRACE_DEPTH)
 		log(TF_ERR) << "Max backtrace depth reached. Backtrace may be incomplete." << flush;
 
@@ -63,11 +72,20 @@ static string make_backtrace()
 	free(bt_pretty);
 	return backtrace_;
 #else
+	(void)bt_buffer;
+	(void)stack_depth;
 	return "[not supported by C library]";
 #endif
 }
 
 
+static string make_backtrace()
+{
+	void *bt_buffer[MAX_BACKTRACE_DEPTH];
+	return symbolize_backtrace(bt_buffer, capture_backtrace(bt_buffer));
+}
+
+
 #ifdef __GNUG__
 // Cf. http://stackoverflow.com/questions/281818/unmangling-the-result-of-stdtype-infoname
 std::string demangle(const char* name) {
@@ -93,15 +111,10 @@ std::string demangle(const char* name) {
 
 
 Error::Error(const string &message)
-: msg_(message),
-  backtrace_(make_backtrace())
+: msg_(message)
 {}
 
 
-const string &Error::backtrace() const
-{ return backtrace_; }
-
-
 const char* Error::what() const noexcept
 { return msg_.c_str(); }
 
@@ -116,11 +129,76 @@ int IOerror::code()
 { return code_; }
 
 
+IOStatus::IOStatus()
+: kind_(OK)
+, code_(0)
+{}
+
+
+IOStatus::IOStatus(const ExpectedError &e)
+: kind_(OTHER)
+, code_(0)
+, msg_(e.what())
+{}
+
+
+IOStatus IOStatus::io_error(const string &message, int error_code)
+{
+	IOStatus rv;
+	rv.kind_ = IO_ERROR;
+	rv.code_ = error_code;
+	rv.msg_ = message;
+	return rv;
+}
+
+
+IOStatus IOStatus::system_error(const string &message)
+{
+	IOStatus rv;
+	rv.kind_ = SYSTEM_ERROR;
+	rv.msg_ = message;
+	return rv;
+}
+
+
+int IOStatus::code() const
+{ return code_; }
+
+
+string IOStatus::what() const
+{
+	if (kind_ == IO_ERROR)
+		return msg_ + std::strerror(code_);
+	return msg_;
+}
+
+
+void IOStatus::raise() const
+{
+	switch (kind_) {
+	case IO_ERROR:
+		throw IOerror(msg_, code_);
+	case SYSTEM_ERROR:
+		throw SystemError(msg_);
+	case OTHER:
+		throw ExpectedError(msg_);
+	case OK:
+		break;
+	}
+	throw Bug("Attempt to raise a successful IOStatus");
+}
+
+
 Bug::Bug(const string &desc)
 : Error(desc)
+, depth_(capture_backtrace(frames_.data()))
 {}
 
 
+string Bug::backtrace() const
+{ return symbolize_backtrace(frames_.data(), depth_); }
+
+
 void handle_uncaught()
 {
 	std::string err = std::strerror(errno);
@@ -22,6 +22,7 @@
 #ifndef THINKFAN_ERROR_H_
 #define THINKFAN_ERROR_H_
 
+#include <array>
 #include <exception>
 #include <string>
 
@@ -49,18 +50,25 @@ std::string type(const T &t)
 class Error : public std::exception {
 protected:
 	string msg_;
-	string backtrace_;
 public:
 	Error(const string &message = "");
 
 	virtual const char* what() const noexcept override;
-	const string &backtrace() const;
 };
 
 
+/** @brief An error that should never happen. Only this one carries a backtrace: The raw return
+ *  addresses are recorded when it's created, but they're only symbolized if backtrace() is called,
+ *  i.e. when the Bug is actually reported. */
 class Bug : public Error {
 public:
 	Bug(const string &desc = "");
+
+	string backtrace() const;
+
+private:
+	std::array<void *, MAX_BACKTRACE_DEPTH> frames_;
+	int depth_;
 };
 
 class ExpectedError : public Error {
@@ -148,6 +156,33 @@ public:
 	InvocationError(const string &message);
 };
 
+
+/** @brief The outcome of a driver I/O operation, cf. Driver::robust_op().
+ *  Expected runtime failures (e.g. a flaky or missing sensor) are returned as an IOStatus instead of
+ *  being thrown, since they may happen in every cycle. Only if the error isn't tolerated, raise()
+ *  turns it into the corresponding exception. A successful IOStatus doesn't allocate. */
+class IOStatus {
+public:
+	IOStatus();
+	IOStatus(const ExpectedError &e);
+
+	static IOStatus io_error(const string &message, int error_code);
+	static IOStatus system_error(const string &message);
+
+	bool ok() const { return kind_ == OK; }
+	int code() const;
+	string what() const;
+
+	[[noreturn]] void raise() const;
+
+private:
+	enum Kind { OK, IO_ERROR, SYSTEM_ERROR, OTHER };
+
+	Kind kind_;
+	int code_;
+	string msg_;
+};
+
 void handle_uncaught();
 
 
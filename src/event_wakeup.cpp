@@ -0,0 +1,285 @@
+/********************************************************************
+ * event_wakeup.cpp: Wake up the main loop on hardware temperature events
+ * (C) 2026, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+#include "event_wakeup.h"
+#include "config.h"
+#include "sensors.h"
+#include "error.h"
+#include "message.h"
+
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <unistd.h>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+
+namespace thinkfan {
+
+
+int EventWakeup::wake_fd_ = -1;
+
+
+EventWakeup::EventWakeup(const Config &config)
+: config_(config)
+, uevent_fd_(-1)
+{
+	wake_fd_ = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (wake_fd_ < 0) {
+		string msg = std::strerror(errno);
+		throw SystemError("eventfd: " + msg);
+	}
+
+	open_uevent_socket();
+
+	pollfds_.push_back({ wake_fd_, POLLIN, 0 });
+	pollfds_.push_back({ uevent_fd_, POLLIN, 0 });
+
+	unsigned int temp_idx = 0;
+	for (const unique_ptr<SensorDriver> &sensor : config.sensors()) {
+		if (dynamic_cast<const HwmonSensorDriver *>(sensor.get()) && sensor->available() && sensor->initialized())
+			add_hwmon_alarm(*sensor, temp_idx);
+		temp_idx += sensor->num_temps();
+	}
+
+	log(TF_INF) << "Waking up on " << static_cast<unsigned int>(alarms_.size()) << " hwmon alarm(s)"
+		<< (uevent_fd_ >= 0 ? " and thermal uevents." : ".") << flush;
+
+	update_thresholds();
+}
+
+
+EventWakeup::~EventWakeup()
+{
+	for (unique_ptr<HwmonAlarm> &alarm : alarms_) {
+		try {
+			alarm->threshold.write_int(alarm->initial_threshold);
+		} catch (IOerror &e) {
+			log(TF_ERR) << "Failed to restore " << alarm->threshold.path() << ": " << e.what() << flush;
+		}
+	}
+
+	if (uevent_fd_ >= 0)
+		::close(uevent_fd_);
+
+	int fd = wake_fd_;
+	wake_fd_ = -1;
+	::close(fd);
+}
+
+
+void EventWakeup::notify()
+{
+	if (wake_fd_ >= 0) {
+		uint64_t one = 1;
+		ssize_t rv = ::write(wake_fd_, &one, sizeof(one));
+		(void)rv;
+	}
+}
+
+
+void EventWakeup::open_uevent_socket()
+{
+	uevent_fd_ = ::socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_KOBJECT_UEVENT);
+	if (uevent_fd_ < 0) {
+		log(TF_INF) << "Cannot receive uevents: socket: " << std::strerror(errno) << flush;
+		return;
+	}
+
+	::sockaddr_nl addr;
+	std::memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = 1; // Kernel uevents
+
+	if (::bind(uevent_fd_, reinterpret_cast<::sockaddr *>(&addr), sizeof(addr)) < 0) {
+		log(TF_INF) << "Cannot receive uevents: bind: " << std::strerror(errno) << flush;
+		::close(uevent_fd_);
+		uevent_fd_ = -1;
+	}
+}
+
+
+void EventWakeup::add_hwmon_alarm(const SensorDriver &sensor, unsigned int temp_idx)
+{
+	const string &input = sensor.path();
+	const string suffix = "_input";
+	if (input.size() <= suffix.size() || input.compare(input.size() - suffix.size(), suffix.size(), suffix))
+		return;
+
+	const string base = input.substr(0, input.size() - suffix.size());
+	unique_ptr<HwmonAlarm> alarm(new HwmonAlarm());
+
+	try {
+		try {
+			alarm->alarm.open(base + "_max_alarm");
+		} catch (IOerror &) {
+			alarm->alarm.open(base + "_alarm");
+		}
+		alarm->threshold.open(base + "_max", O_RDWR);
+
+		// Reading the alarm attribute arms the sysfs notification
+		alarm->alarm.read_int();
+		alarm->initial_threshold = alarm->threshold.read_int();
+	} catch (IOerror &e) {
+		log(TF_DBG) << "No usable alarm for " << input << ": " << e.what() << flush;
+		return;
+	}
+
+	alarm->temp_idx = temp_idx;
+	alarm->correction = sensor.correction().empty() ? 0 : sensor.correction().front();
+	alarm->cur_threshold = alarm->initial_threshold;
+
+	pollfds_.push_back({ alarm->alarm.fd(), POLLPRI, 0 });
+	alarms_.push_back(std::move(alarm));
+}
+
+
+void EventWakeup::remove_alarm(size_t idx, const string &reason)
+{
+	log(TF_INF) << "Not using " << alarms_[idx]->alarm.path() << " anymore: " << reason << flush;
+	alarms_.erase(alarms_.begin() + long(idx));
+	pollfds_.erase(pollfds_.begin() + 2 + long(idx));
+}
+
+
+opt<int> EventWakeup::upper_limit(unsigned int temp_idx) const
+{
+	opt<int> rv;
+
+	for (const unique_ptr<FanConfig> &fan_config : config_.fan_configs()) {
+		if (const CurveMapping *curve = dynamic_cast<const CurveMapping *>(fan_config.get())) {
+			if (opt<int> limit = curve->upper_limit())
+				rv = std::min(*limit, rv.value_or(*limit));
+			continue;
+		}
+
+		const StepwiseMapping *mapping = dynamic_cast<const StepwiseMapping *>(fan_config.get());
+		if (!mapping || &mapping->cur_level() == mapping->levels().back().get())
+			continue;
+
+		const Level &level = mapping->cur_level();
+		int limit = dynamic_cast<const ComplexLevel *>(&level)
+			? level.upper_limit()[temp_idx]
+			: level.upper_limit().front();
+
+		rv = std::min(limit, rv.value_or(limit));
+	}
+
+	return rv;
+}
+
+
+void EventWakeup::update_thresholds()
+{
+	for (size_t i = 0; i < alarms_.size(); ) {
+		HwmonAlarm &alarm = *alarms_[i];
+		opt<int> limit = upper_limit(alarm.temp_idx);
+
+		int threshold = alarm.initial_threshold;
+		// The alarm goes off when the temperature exceeds temp*_max
+		if (limit && *limit - alarm.correction > -200 && *limit - alarm.correction < 200)
+			threshold = (*limit - alarm.correction - 1) * 1000;
+
+		if (threshold != alarm.cur_threshold) {
+			try {
+				alarm.threshold.write_int(threshold);
+				alarm.cur_threshold = threshold;
+			} catch (IOerror &e) {
+				remove_alarm(i, e.what());
+				continue;
+			}
+		}
+		++i;
+	}
+}
+
+
+bool EventWakeup::handle_uevents()
+{
+	bool thermal = false;
+	char buf[4096];
+	ssize_t len;
+
+	while ((len = ::recv(uevent_fd_, buf, sizeof(buf) - 1, 0)) > 0) {
+		buf[len] = 0;
+		// The message consists of NUL-separated KEY=VALUE pairs
+		for (const char *pos = buf; pos < buf + len; pos += std::strlen(pos) + 1)
+			if (!std::strcmp(pos, "SUBSYSTEM=thermal"))
+				thermal = true;
+	}
+
+	return thermal;
+}
+
+
+bool EventWakeup::sleep_until(std::chrono::steady_clock::time_point until)
+{
+	bool woken = false;
+
+	while (!woken && !interrupted) {
+		// Round up so we don't wake up just before the deadline and spin
+		auto remaining = std::chrono::ceil<std::chrono::milliseconds>(
+			until - std::chrono::steady_clock::now()
+		).count();
+		if (remaining <= 0)
+			break;
+
+		int rv = ::poll(pollfds_.data(), pollfds_.size(), int(remaining));
+		if (rv < 0) {
+			if (errno == EINTR)
+				continue;
+			string msg = std::strerror(errno);
+			throw SystemError("poll: " + msg);
+		}
+
+		if (pollfds_[0].revents) {
+			uint64_t count;
+			ssize_t rv = ::read(wake_fd_, &count, sizeof(count));
+			(void)rv;
+		}
+
+		if (pollfds_[1].revents && handle_uevents())
+			woken = true;
+
+		for (size_t i = 0; i < alarms_.size(); ) {
+			if (pollfds_[i + 2].revents & (POLLPRI | POLLERR)) {
+				try {
+					// Re-arm the notification
+					alarms_[i]->alarm.read_int();
+					woken = true;
+				} catch (IOerror &e) {
+					remove_alarm(i, e.what());
+					continue;
+				}
+			}
+			++i;
+		}
+	}
+
+	if (woken)
+		log(TF_DBG) << "Woken up by a temperature event." << flush;
+
+	return woken;
+}
+
+
+} // namespace thinkfan
@@ -0,0 +1,81 @@
+#pragma once
+
+/********************************************************************
+ * event_wakeup.h: Wake up the main loop on hardware temperature events
+ * (C) 2026, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+#include "thinkfan.h"
+#include "persistent_file.h"
+
+#include <poll.h>
+
+namespace thinkfan {
+
+
+/** @brief Lets the main loop sleep until the cycle time is up, a signal arrives, or the hardware
+ *  reports a temperature spike (option -e).
+ *  For every hwmon sensor that has a writable temp*_max and a temp*_max_alarm (or temp*_alarm)
+ *  attribute, temp*_max is set just below the upper limit of the current level and the alarm
+ *  attribute is polled for POLLPRI. Since this overwrites a hardware setting, the original value is
+ *  restored on exit. Additionally, any uevent from the thermal subsystem (e.g. a thermal zone trip
+ *  point) wakes us up. */
+class EventWakeup {
+public:
+	EventWakeup(const Config &config);
+	EventWakeup(const EventWakeup &) = delete;
+	~EventWakeup();
+
+	/// @brief Re-program the hwmon thresholds after the fan levels may have changed.
+	void update_thresholds();
+
+	/// @return true if we were woken up by a hardware event before @a until
+	bool sleep_until(std::chrono::steady_clock::time_point until);
+
+	/// @brief Interrupt sleep() from a signal handler. Async-signal-safe.
+	static void notify();
+
+private:
+	struct HwmonAlarm {
+		// Index into the TemperatureState
+		unsigned int temp_idx;
+		int correction;
+		PersistentFile alarm;
+		PersistentFile threshold;
+		int initial_threshold;
+		int cur_threshold;
+	};
+
+	void add_hwmon_alarm(const SensorDriver &sensor, unsigned int temp_idx);
+	void open_uevent_socket();
+	void remove_alarm(size_t idx, const string &reason);
+	opt<int> upper_limit(unsigned int temp_idx) const;
+	bool handle_uevents();
+
+	const Config &config_;
+	vector<unique_ptr<HwmonAlarm>> alarms_;
+	int uevent_fd_;
+	// [0]: wake_fd_, [1]: uevent_fd_, then one per alarm
+	vector<::pollfd> pollfds_;
+
+	static int wake_fd_;
+};
+
+
+} // namespace thinkfan
@@ -26,7 +26,6 @@
 
 #include <fstream>
 #include <cstring>
-#include <thread>
 #include <typeinfo>
 
 #ifdef USE_NVML
@@ -35,6 +34,9 @@
 
 namespace thinkfan {
 
+
+static const string level_disengaged("level disengaged");
+
 /*----------------------------------------------------------------------------
 | FanDriver: Superclass of TpFanDriver and HwmonFanDriver. Can set the speed |
 | on its own since an implementation-specific string representation is       |
@@ -44,6 +46,7 @@ namespace thinkfan {
 FanDriver::FanDriver(bool optional, unsigned int watchdog_timeout, opt<unsigned int> max_errors)
 : Driver(optional, max_errors.value_or(0)),
   current_speed_("_"),
+  speed_confirmed_(false),
   watchdog_(watchdog_timeout),
   depulse_(0)
 {}
@@ -51,24 +54,37 @@ FanDriver::FanDriver(bool optional, unsigned int watchdog_timeout, opt<unsigned
 FanDriver::~FanDriver() noexcept(false)
 {}
 
-void FanDriver::set_speed(const string &level)
-{ robust_io(&FanDriver::set_speed_, level); }
+void FanDriver::set_speed(const string &level, bool force)
+{ robust_io(&FanDriver::set_speed_, level, bool(force)); }
 
-void FanDriver::skip_io_error(const ExpectedError &)
+void FanDriver::skip_io_error(const IOStatus &)
 {}
 
 
-void FanDriver::set_speed_(const string &level)
+IOStatus FanDriver::set_speed_(const string &level, bool force)
 {
-	std::ofstream f_out(path());
-	if(!(f_out << level << std::flush)) {
-		int err = errno;
+	if (!force && speed_confirmed_ && level == current_speed_)
+		return IOStatus();
+
+	if (int err = ctrl_file_.try_write(level.data(), level.length())) {
+		speed_confirmed_ = false;
 		if (err == EPERM)
-			throw SystemError(MSG_FAN_EPERM(path()));
+			return IOStatus::system_error(MSG_FAN_EPERM(path()));
 		else
-			throw IOerror(MSG_FAN_CTRL(level, path()), err);
+			return IOStatus::io_error(MSG_FAN_CTRL(level, path()), err);
 	}
 	current_speed_ = level;
+	speed_confirmed_ = true;
+	last_watchdog_ping_ = std::chrono::system_clock::now();
+	return IOStatus();
+}
+
+
+void FanDriver::open_ctrl_file()
+{
+	ctrl_file_.open(path(), O_WRONLY);
+	// Whatever we wrote before may have been overridden, e.g. by the firmware
+	speed_confirmed_ = false;
 }
 
 
@@ -93,7 +109,8 @@ const string &FanDriver::current_speed() const
 TpFanDriver::TpFanDriver(const std::string &path, bool optional, opt<unsigned int> max_errors)
 : FanDriver(optional, 120, max_errors)
 , path_(path)
-{}
+, reengage_level_(nullptr)
+{ set_depulse(depulse); }
 
 
 TpFanDriver::~TpFanDriver() noexcept(false)
@@ -125,21 +142,39 @@ void TpFanDriver::set_depulse(float duration)
 
 void TpFanDriver::set_speed(const Level &level)
 {
+	// Cancel a pending re-engage from depulsing, the new level takes precedence
+	reengage_at_.reset();
 	FanDriver::set_speed(level.str());
-	last_watchdog_ping_ = std::chrono::system_clock::now();
 }
 
 
 void TpFanDriver::ping_watchdog_and_depulse(const Level &level)
 {
 	if (depulse_ > std::chrono::milliseconds(0)) {
-		FanDriver::set_speed("level disengaged");
-		std::this_thread::sleep_for(depulse_);
-		set_speed(level);
+		// If the depulse time is longer than a cycle, the fan still has to be re-engaged first
+		if (!reengage_at_) {
+			FanDriver::set_speed(level_disengaged);
+			reengage_at_ = std::chrono::steady_clock::now()
+				+ std::chrono::duration_cast<std::chrono::steady_clock::duration>(depulse_);
+			reengage_level_ = &level;
+		}
 	}
 	else if (last_watchdog_ping_ + watchdog_ - sleeptime <= std::chrono::system_clock::now()) {
 		log(TF_DBG) << "Watchdog ping" << flush;
-		set_speed(level);
+		FanDriver::set_speed(level.str(), true);
+	}
+}
+
+
+opt<std::chrono::steady_clock::time_point> TpFanDriver::next_timer() const
+{ return reengage_at_; }
+
+
+void TpFanDriver::handle_timer()
+{
+	if (reengage_at_ && *reengage_at_ <= std::chrono::steady_clock::now()) {
+		reengage_at_.reset();
+		FanDriver::set_speed(reengage_level_->str(), true);
 	}
 }
 
@@ -176,10 +211,11 @@ void TpFanDriver::init()
 		throw SystemError(MSG_FAN_INIT(path()) + "Failed to read initial state.");
 
 	f.close();
-	f.open(path());
+	open_ctrl_file();
 
-	if (!(f << "watchdog " << watchdog_.count() << std::flush))
-		throw IOerror(MSG_FAN_INIT(path()), errno);
+	const string watchdog = "watchdog " + std::to_string(watchdog_.count());
+	if (int err = ctrl_file_.try_write(watchdog.data(), watchdog.length()))
+		throw IOerror(MSG_FAN_INIT(path()), err);
 }
 
 
@@ -214,6 +250,9 @@ HwmonFanDriver::HwmonFanDriver(
 )
 : FanDriver(optional, 0, max_errors)
 , hwmon_interface_(hwmon_interface)
+, slew_rate_(0)
+, cur_pwm_(-1)
+, ramp_target_(-1)
 {}
 
 
@@ -253,6 +292,16 @@ void HwmonFanDriver::init()
 
 	if (!(f << "1" << std::flush))
 		throw IOerror(MSG_FAN_INIT(path()), errno);
+
+	open_ctrl_file();
+
+	// A ramp starts from whatever the fan is set to right now
+	ramp_next_.reset();
+	cur_pwm_ = -1;
+	std::ifstream pwm_in(path());
+	int pwm;
+	if (pwm_in >> pwm)
+		cur_pwm_ = pwm;
 }
 
 string HwmonFanDriver::lookup()
@@ -264,15 +313,86 @@ string HwmonFanDriver::type_name() const
 
 void HwmonFanDriver::set_speed(const Level &level)
 {
-	try {
-		FanDriver::set_speed(std::to_string(level.num()));
-	} catch (IOerror &e) {
-		if (e.code() == EINVAL) {
-			// This happens when the hwmon kernel driver is reset to automatic control
-			// e.g. after the system has woken up from suspend.
-			// In that case, we need to re-initialize and try once more.
-			init();
-			FanDriver::set_speed(std::to_string(level.num()));
+	if (slew_rate_) {
+		set_pwm(level.num());
+		return;
+	}
+
+	robust_io(&HwmonFanDriver::set_pwm_, level.num_str());
+	cur_pwm_ = speed_confirmed_ ? level.num() : -1;
+}
+
+
+void HwmonFanDriver::set_pwm(int pwm)
+{
+	if (!slew_rate_ || cur_pwm_ < 0) {
+		ramp_next_.reset();
+		write_pwm(pwm);
+		return;
+	}
+
+	ramp_target_ = pwm;
+	if (!ramp_next_) {
+		// Start moving right away
+		ramp_last_step_ = std::chrono::steady_clock::now() - ramp_tick;
+		ramp_step();
+	}
+}
+
+
+void HwmonFanDriver::set_slew_rate(unsigned int rate)
+{ slew_rate_ = rate; }
+
+
+void HwmonFanDriver::write_pwm(int pwm)
+{
+	const string speed = std::to_string(pwm);
+	robust_io(&HwmonFanDriver::set_pwm_, speed);
+	cur_pwm_ = speed_confirmed_ ? pwm : -1;
+}
+
+
+void HwmonFanDriver::ramp_step()
+{
+	const auto now = std::chrono::steady_clock::now();
+	const double elapsed = std::chrono::duration<double>(now - ramp_last_step_).count();
+	const int max_step = std::max(1, int(slew_rate_ * elapsed));
+	ramp_last_step_ = now;
+
+	write_pwm(cur_pwm_ + std::clamp(ramp_target_ - cur_pwm_, -max_step, max_step));
+
+	if (cur_pwm_ < 0 || cur_pwm_ == ramp_target_)
+		// Done, or we've lost track of the fan (then the next set_pwm() just jumps)
+		ramp_next_.reset();
+	else
+		ramp_next_ = now + std::max<std::chrono::steady_clock::duration>(
+			ramp_tick,
+			std::chrono::duration_cast<std::chrono::steady_clock::duration>(secondsf(1.0 / slew_rate_))
+		);
+}
+
+
+opt<std::chrono::steady_clock::time_point> HwmonFanDriver::next_timer() const
+{ return ramp_next_; }
+
+
+void HwmonFanDriver::handle_timer()
+{
+	if (ramp_next_ && *ramp_next_ <= std::chrono::steady_clock::now())
+		ramp_step();
+}
+
+
+IOStatus HwmonFanDriver::set_pwm_(const string &level)
+{
+	IOStatus status = set_speed_(level, false);
+	if (unlikely(status.code() == EINVAL)) {
+		// This happens when the hwmon kernel driver is reset to automatic control
+		// e.g. after the system has woken up from suspend.
+		// In that case, we need to re-initialize and try once more.
+		init();
+		status = set_speed_(level, false);
+		if (status.ok()) {
 			log(TF_WRN) << path() << ": WARNING: Userspace fan control had to be automatically re-initialized." << flush;
 #if defined(HAVE_SYSTEMD)
 			log(TF_WRN) << "This should have been taken care of when enabling the thinkfan systemd service." << flush
@@ -281,10 +401,10 @@ void HwmonFanDriver::set_speed(const Level &level)
 #else
 			log(TF_WRN) << "Please arrange for a SIGUSR2 to be sent to thinkfan after resuming from suspend." << flush;
 #endif
-		} else {
-			throw;
 		}
 	}
+
+	return status;
 }
 
 
@@ -24,6 +24,7 @@
 #include "thinkfan.h"
 #include "driver.h"
 #include "hwmon.h"
+#include "persistent_file.h"
 
 namespace thinkfan {
 
@@ -41,18 +42,31 @@ public:
 	virtual void ping_watchdog_and_depulse(const Level &) {}
 	bool operator == (const FanDriver &other) const;
 
+	/// @return When handle_timer() must be called next, if at all. The main loop wakes up for it.
+	virtual opt<std::chrono::steady_clock::time_point> next_timer() const { return nullopt; }
+	/// @brief Called by the main loop whenever it wakes up. Does whatever is due by now.
+	virtual void handle_timer() {}
+
 protected:
-	void set_speed(const string &level);
+	/// @brief Write @a level to the fan control, unless it's what we have last written successfully
+	/// and @a force is false.
+	void set_speed(const string &level, bool force = false);
+	IOStatus set_speed_(const string &level, bool force);
+
+	/// @brief Open the fan control file, which stays open until the next init().
+	void open_ctrl_file();
 
 	string initial_state_;
 	string current_speed_;
+	// Whether current_speed_ has been written successfully since the last init()
+	bool speed_confirmed_;
+	PersistentFile ctrl_file_;
 	seconds watchdog_;
 	secondsf depulse_;
 	std::chrono::system_clock::time_point last_watchdog_ping_;
 
 private:
-	virtual void skip_io_error(const ExpectedError &e) override;
-	void set_speed_(const string &level);
+	virtual void skip_io_error(const IOStatus &e) override;
 };
 
 
@@ -64,8 +78,14 @@ public:
 	void set_watchdog(const unsigned int timeout);
 	void set_depulse(float duration);
 	virtual void set_speed(const Level &level) override;
+
+	/// @brief Ping the watchdog if it's due, or disengage the fan for the depulse time. The fan is
+	/// re-engaged to @a level by handle_timer(), so this doesn't block.
 	virtual void ping_watchdog_and_depulse(const Level &level) override;
 
+	virtual opt<std::chrono::steady_clock::time_point> next_timer() const override;
+	virtual void handle_timer() override;
+
 protected:
 	virtual void init() override;
 	virtual string lookup() override;
@@ -73,6 +93,10 @@ protected:
 
 private:
 	const string path_;
+
+	// Only while the fan is disengaged for depulsing: When to re-engage and at what level
+	opt<std::chrono::steady_clock::time_point> reengage_at_;
+	const Level *reengage_level_;
 };
 
 
@@ -89,13 +113,39 @@ public:
 	virtual ~HwmonFanDriver() noexcept(false) override;
 	virtual void set_speed(const Level &level) override;
 
+	/// @brief Set an arbitrary PWM value (0 - 255), i.e. not one from a Level
+	void set_pwm(int pwm);
+
+	/// @brief Limit how fast the PWM value may change, in PWM steps per second. 0 means no limit.
+	/// With a limit, set_speed() and set_pwm() only set a target, and handle_timer() ramps the fan
+	/// towards it in between control cycles.
+	void set_slew_rate(unsigned int rate);
+
+	virtual opt<std::chrono::steady_clock::time_point> next_timer() const override;
+	virtual void handle_timer() override;
+
 protected:
 	virtual void init() override;
 	virtual string lookup() override;
 	virtual string type_name() const override;
 
 private:
+	IOStatus set_pwm_(const string &level);
+	void write_pwm(int pwm);
+	void ramp_step();
+
 	shared_ptr<HwmonInterface<FanDriver>> hwmon_interface_;
+
+	// Shortest time between two ramp steps
+	static constexpr std::chrono::milliseconds ramp_tick { 100 };
+
+	unsigned int slew_rate_;
+	// The PWM value the fan is known to have, -1 if unknown
+	int cur_pwm_;
+	int ramp_target_;
+	std::chrono::steady_clock::time_point ramp_last_step_;
+	// Only while ramping: When to take the next step
+	opt<std::chrono::steady_clock::time_point> ramp_next_;
 };
 
 
@@ -25,6 +25,9 @@
 #include "sensors.h"
 #include "message.h"
 
+#include <algorithm>
+#include <cmath>
+
 namespace thinkfan {
 
 std::weak_ptr<LibsensorsInterface> LibsensorsInterface::instance_;
@@ -47,9 +50,9 @@ LibsensorsInterface::~LibsensorsInterface()
 }
 
 
-LibsensorsInterface::InitGuard::InitGuard(LMSensorsDriver *client)
-: client_(client)
-, iface_(LibsensorsInterface::instance_.lock())
+LibsensorsInterface::InitGuard::InitGuard()
+: iface_(LibsensorsInterface::instance_.lock())
+, success_(false)
 {
 	if (!iface_->libsensors_initialized_) {
 		int err;
@@ -60,13 +63,17 @@ LibsensorsInterface::InitGuard::InitGuard(LMSensorsDriver *client)
 }
 
 
+void LibsensorsInterface::InitGuard::dismiss()
+{ success_ = true; }
+
+
 LibsensorsInterface::InitGuard::~InitGuard()
 {
-	if (iface_->libsensors_initialized_ && iface_->clients_[client_].features.empty()) {
+	if (iface_->libsensors_initialized_ && !success_) {
 
 		// Make all clients unavailable (they have to lookup again!)
-		for (auto drv_entry : iface_->clients_)
-			drv_entry.first->set_unavailable();
+		for (LMSensorsDriver *client : iface_->clients_)
+			client->set_unavailable();
 		iface_->clients_.clear();
 
 		::sensors_cleanup();
@@ -89,11 +96,12 @@ shared_ptr<LibsensorsInterface> LibsensorsInterface::instance()
 }
 
 
-string LibsensorsInterface::lookup_client_features(LMSensorsDriver *client)
+string LibsensorsInterface::lookup_client_features(LMSensorsDriver *client, chip_features &cf)
 {
-	chip_features cf;
-	InitGuard ig(client);
+	InitGuard ig;
 
+	cf.features.clear();
+	cf.inputs.clear();
 	cf.chip = find_chip_by_name(client->chip_name());
 
 	for (const string& feature_name : client->feature_names()) {
@@ -108,43 +116,116 @@ string LibsensorsInterface::lookup_client_features(LMSensorsDriver *client)
 				+ "' of the chip '" + client->chip_name()
 				+ "' does not have a temperature input sensor");
 		cf.features.push_back({feature, sub_feature});
+		cf.inputs.push_back(open_direct_input(*cf.chip, *sub_feature));
 
 		log(TF_DBG) << "Initialized LM sensors temperature input of feature '"
 			+ feature_name + "' of chip '" + client->chip_name() + "'." << flush;
 	}
 
-	clients_.insert({client, cf});
+	if (std::find(clients_.begin(), clients_.end(), client) == clients_.end())
+		clients_.push_back(client);
+	ig.dismiss();
 	return cf.chip->path;
 }
 
 
-vector<double> LibsensorsInterface::get_temps(LMSensorsDriver *client)
+void LibsensorsInterface::remove_client(LMSensorsDriver *client)
+{ clients_.erase(std::remove(clients_.begin(), clients_.end(), client), clients_.end()); }
+
+
+unique_ptr<PersistentFile> LibsensorsInterface::open_direct_input(
+	const ::sensors_chip_name &chip,
+	const ::sensors_subfeature &sub_feature
+) {
+	if (!chip.path || !(sub_feature.flags & SENSORS_MODE_R))
+		return nullptr;
+
+	unique_ptr<PersistentFile> file(new PersistentFile());
+	string path = string(chip.path) + "/" + sub_feature.name;
+	try {
+		file->open(path);
+	} catch (IOerror &e) {
+		log(TF_DBG) << "Reading LM sensors feature '" << sub_feature.name
+			<< "' through libsensors: " << e.what() << flush;
+		return nullptr;
+	}
+
+	if (same_as_libsensors(chip, sub_feature, *file)) {
+		log(TF_DBG) << "Reading LM sensors feature '" << sub_feature.name
+			<< "' directly from " << path << "." << flush;
+		return file;
+	}
+
+	log(TF_DBG) << "Reading LM sensors feature '" << sub_feature.name
+		<< "' through libsensors since its value differs from " << path << "." << flush;
+	return nullptr;
+}
+
+
+bool LibsensorsInterface::same_as_libsensors(
+	const ::sensors_chip_name &chip,
+	const ::sensors_subfeature &sub_feature,
+	PersistentFile &file
+) {
+	// There's no API to ask libsensors whether a compute statement applies, so we check whether it
+	// reports exactly what's in the file. Try twice in case the temperature changes in between.
+	// A compute statement can still give the same value at one particular temperature, which is
+	// why get_temps() repeats this check periodically.
+	for (int attempt = 0; attempt < 2; ++attempt) {
+		double lib_value;
+		int raw;
+		if (file.try_read_int(raw) || ::sensors_get_value(&chip, sub_feature.number, &lib_value))
+			return false;
+		if (std::abs(lib_value - raw / 1000.0) < 0.0005)
+			return true;
+	}
+	return false;
+}
+
+
+IOStatus LibsensorsInterface::get_temps(chip_features &cf, const string &chip_name, double *temps) const
 {
-	chip_features &cf = clients_.at(client);
-	vector<double> rv;
+	const bool check_direct = unlikely(++cf.reads % direct_check_interval == 0);
 
-	for (auto chip_feature : cf.features) {
+	for (size_t i = 0; i < cf.features.size(); ++i) {
+		const auto &chip_feature = cf.features[i];
 		auto sub_feature = chip_feature.second;
 		double real_value = MIN_CELSIUS_TEMP;
+		int err = 0;
+
+		if (unlikely(check_direct && cf.inputs[i] && !same_as_libsensors(*cf.chip, *sub_feature, *cf.inputs[i]))) {
+			log(TF_INF) << "LM sensors feature '" << sub_feature->name << "' of chip '" << chip_name
+				<< "' differs from " << cf.inputs[i]->path() << ", reading it through libsensors from now on."
+				<< flush;
+			cf.inputs[i].reset();
+		}
+
+		if (likely(cf.inputs[i] != nullptr)) {
+			int raw;
+			if (unlikely(err = cf.inputs[i]->try_read_int(raw)))
+				return IOStatus::io_error(MSG_T_GET(cf.inputs[i]->path()), err);
+			real_value = raw / 1000.0;
+		}
+		else
+			err = ::sensors_get_value(cf.chip, sub_feature->number, &real_value);
 
-		int err = ::sensors_get_value(cf.chip, sub_feature->number, &real_value);
 		if (err)
-			throw SystemError(
+			return IOStatus::system_error(
 				string("temperature input value of feature '") + chip_feature.first->name
-				+ "' of chip '" + client->chip_name()
+				+ "' of chip '" + chip_name
 				+ "' is unavailable: " + ::sensors_strerror(err)
 			);
 		else if (real_value < MIN_CELSIUS_TEMP) // Make sure the reported value is physically valid.
-			throw SystemError(
+			return IOStatus::system_error(
 				string("Invalid temperature on feature '") + chip_feature.first->name
-				+ "' of chip '" + client->chip_name()
+				+ "' of chip '" + chip_name
 				+ "': " + std::to_string(real_value)
 			);
 
-		rv.push_back(real_value);
+		*temps++ = real_value;
 	}
 
-	return rv;
+	return IOStatus();
 }
 
 
@@ -22,11 +22,11 @@
 #pragma once
 
 #include "thinkfan.h"
+#include "persistent_file.h"
 
 #ifdef USE_LM_SENSORS
 #include <sensors/sensors.h>
 #include <sensors/error.h>
-#include <map>
 
 namespace thinkfan {
 
@@ -43,25 +43,40 @@ public:
 
 	static shared_ptr<LibsensorsInterface> instance();
 
-	string lookup_client_features(LMSensorsDriver *client);
-	vector<double> get_temps(LMSensorsDriver *client);
-
-private:
+	/// @brief The features of one chip that a client reads. Owned by the client, filled in by
+	/// lookup_client_features() and cleared when libsensors is re-initialized.
 	struct chip_features {
 		const ::sensors_chip_name *chip = nullptr;
 		vector<pair<const ::sensors_feature *, const ::sensors_subfeature *>> features;
+		// Per feature: The sysfs file to read directly, or nullptr to go through libsensors
+		vector<unique_ptr<PersistentFile>> inputs;
+		// Counts get_temps() calls to schedule the next cross-check of the direct inputs
+		unsigned int reads = 0;
 	};
 
+	string lookup_client_features(LMSensorsDriver *client, chip_features &cf);
+	void remove_client(LMSensorsDriver *client);
+
+	/// @brief Read the temperatures of all features in @a cf into @a temps, which must have room
+	/// for cf.features.size() values. Every @a direct_check_interval calls, values read directly
+	/// from sysfs are compared against libsensors, and features where they differ go back to
+	/// being read through libsensors.
+	IOStatus get_temps(chip_features &cf, const string &chip_name, double *temps) const;
+
+	static constexpr unsigned int direct_check_interval = 64;
+
+private:
 	/** @brief A scope guard to un-initialize libsensors when a requested feature/subfeature
 	 * isn't found. This is necessary because libsensors doesn't pick up kernel drivers that
 	 * are loaded after initialization. */
 	class InitGuard {
 	public:
-		InitGuard(LMSensorsDriver *client);
+		InitGuard();
 		~InitGuard();
+		void dismiss();
 	private:
-		LMSensorsDriver *client_;
 		shared_ptr<LibsensorsInterface> iface_;
+		bool success_;
 	};
 
 	LibsensorsInterface();
@@ -84,9 +99,21 @@ private:
 		const string &feature_name
 	);
 
+	unique_ptr<PersistentFile> open_direct_input(
+		const ::sensors_chip_name &chip,
+		const ::sensors_subfeature &sub_feature
+	);
+
+	/// @return Whether libsensors reports the same value that's in @a file
+	static bool same_as_libsensors(
+		const ::sensors_chip_name &chip,
+		const ::sensors_subfeature &sub_feature,
+		PersistentFile &file
+	);
+
 	static std::weak_ptr<LibsensorsInterface> instance_;
 
-	std::map<LMSensorsDriver *, chip_features> clients_;
+	vector<LMSensorsDriver *> clients_;
 	bool libsensors_initialized_;
 };
 
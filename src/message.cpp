@@ -172,13 +172,8 @@ Logger &Logger::operator<< (const TemperatureState &ts)
 {
 	msg_pfx_ += "Temperatures(bias): ";
 
-	vector<float>::const_iterator bias_it;
-	vector<int>::const_iterator temp_it;
-
-	for (temp_it = ts.temps().cbegin(), bias_it = ts.biases().cbegin();
-			temp_it != ts.temps().cend() && bias_it != ts.biases().cend();
-			++temp_it, ++bias_it)
-		msg_pfx_ += std::to_string(*temp_it) + "(" + std::to_string(int(*bias_it)) + "), ";
+	for (unsigned int i = 0; i < ts.size(); ++i)
+		msg_pfx_ += std::to_string(ts.temps()[i]) + "(" + std::to_string(ts.bias(i)) + "), ";
 
 	msg_pfx_.pop_back(); msg_pfx_.pop_back();
 	return *this;
@@ -119,9 +119,11 @@ template<class ErrT, class... ArgTs> void error(const ArgTs &... args) {
 #define MSG_TITLE "thinkfan " VERSION ": A minimalist fan control program"
 
 #define MSG_USAGE \
- "Usage: thinkfan [-hnqDd [-b BIAS] [-c CONFIG] [-s SECONDS] [-p [SECONDS]]]" \
+ "Usage: thinkfan [-hnqeDd [-b BIAS] [-c CONFIG] [-s SECONDS] [-p [SECONDS]] [-a [SECONDS]]]" \
  "\n -h  This help message" \
  "\n -s  Maximum cycle time in seconds (Integer. Default: 5)" \
+ "\n -e  Wake up early on hwmon temperature alarms and thermal uevents. Allows" \
+ "\n     a cycle time of up to 60 seconds." \
  "\n -b  Floating point number (-10 to 30) to control rising temperature" \
  "\n     exaggeration (see thinkfan(5)). Default: 0.0" \
  "\n -c  Load different configuration file (default: /etc/thinkfan.conf)" \
@@ -131,6 +133,9 @@ template<class ErrT, class... ArgTs> void error(const ArgTs &... args) {
  "\n -v  Enable verbose logging (e.g. log temperatures continuously)." \
  "\n -p  Use the pulsing-fan workaround (for worn out fans). Takes an optional" \
  "\n     floating-point argument (0 ~ 10s) as depulsing duration. Default 0.5s." \
+ "\n -a  Read slow sensors (libsensors, NVML, libatasmart) in the background." \
+ "\n     Takes an optional floating-point argument (0 ~ 10s) as the time to wait" \
+ "\n     for their readings in each cycle. Default 0.5s." \
  DND_DISK_HELP \
  "\n -D  DANGEROUS mode: Disable all sanity checks. May result in undefined" \
  "\n     behaviour!\n"
@@ -142,6 +147,11 @@ template<class ErrT, class... ArgTs> void error(const ArgTs &... args) {
 #define MSG_CONFIG(path) \
  "Config as read from " + path + ":\nFan level\tLow\tHigh"
 #define MSG_CONF_ITEM(level, low, high) " " + std::to_string(level) + "\t\t" + std::to_string(low) + "\t" + std::to_string(high)
+#define MSG_SKIPPED_EVALS(fan, skipped, total) fan + ": Temperatures were unchanged in " \
+	+ std::to_string(skipped) + " of " + std::to_string(total) + " cycles"
+#define MSG_TP_READ_TIME(sensor, last, max) sensor + ": Last read took " + std::to_string(last) \
+	+ " us, the slowest one " + std::to_string(max) + " us"
+#define MSG_CACHE_AGE(sensor, age) sensor + ": Cached temperature is " + std::to_string(age) + " s old"
 #define MSG_TERM "Cleaning up and resetting fan control."
 #define MSG_DEPULSE(delay, time) "Disengaging the fan controller for " \
 	<< time << " seconds every " << delay << " seconds"
@@ -185,6 +195,7 @@ template<class ErrT, class... ArgTs> void error(const ArgTs &... args) {
 #define MSG_OPT_B_NOARG "option -b requires an argument!"
 #define MSG_OPT_B_INVAL(x) string("invalid argument to option -b: ") + x
 #define MSG_OPT_P(x) string("invalid argument to option -p: ") + x
+#define MSG_OPT_A(x) string("invalid argument to option -a: ") + x
 
 
 #define MSG_CONF_DEFAULT_FAN "Using default fan control in " DEFAULT_FAN "."
@@ -0,0 +1,172 @@
+/********************************************************************
+ * nvml.cpp: State management for the nVidia Management Library
+ * (C) 2026, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+#include "nvml.h"
+#include "error.h"
+#include "message.h"
+#include "sensor_sweep.h"
+
+#ifdef USE_NVML
+#include <dlfcn.h>
+#include <cstring>
+#include <algorithm>
+
+namespace thinkfan {
+
+std::weak_ptr<NvmlInterface> NvmlInterface::instance_;
+
+
+NvmlInterface::NvmlInterface()
+: nvml_initialized_(false),
+  dl_nvmlInit_v2(nullptr),
+  dl_nvmlDeviceGetHandleByPciBusId_v2(nullptr),
+  dl_nvmlDeviceGetName(nullptr),
+  dl_nvmlDeviceGetTemperature(nullptr),
+  dl_nvmlShutdown(nullptr)
+{
+	if (!(nvml_so_handle_ = dlopen("libnvidia-ml.so.1", RTLD_LAZY))) {
+		string msg = strerror(errno);
+		throw SystemError("Failed to load libnvidia-ml.so.1: " + msg);
+	}
+
+	/* Apparently GCC doesn't want to cast to function pointers, so we have to do
+	 * this kind of weird stuff.
+	 * See http://stackoverflow.com/questions/1096341/function-pointers-casting-in-c
+	 */
+	*reinterpret_cast<void **>(&dl_nvmlInit_v2) = dlsym(nvml_so_handle_, "nvmlInit_v2");
+	*reinterpret_cast<void **>(&dl_nvmlDeviceGetHandleByPciBusId_v2) = dlsym(
+			nvml_so_handle_, "nvmlDeviceGetHandleByPciBusId_v2");
+	*reinterpret_cast<void **>(&dl_nvmlDeviceGetName) = dlsym(nvml_so_handle_, "nvmlDeviceGetName");
+	*reinterpret_cast<void **>(&dl_nvmlDeviceGetTemperature) = dlsym(nvml_so_handle_, "nvmlDeviceGetTemperature");
+	*reinterpret_cast<void **>(&dl_nvmlShutdown) = dlsym(nvml_so_handle_, "nvmlShutdown");
+
+	if (!(dl_nvmlDeviceGetHandleByPciBusId_v2 && dl_nvmlDeviceGetName &&
+			dl_nvmlDeviceGetTemperature && dl_nvmlInit_v2 && dl_nvmlShutdown)) {
+		dlclose(nvml_so_handle_);
+		throw SystemError("Incompatible NVML driver.");
+	}
+
+	log(TF_DBG) << "Loaded libnvidia-ml.so.1." << flush;
+}
+
+
+NvmlInterface::~NvmlInterface()
+{
+	nvmlReturn_t ret;
+	if (nvml_initialized_ && (ret = dl_nvmlShutdown()))
+		log(TF_ERR) << "Failed to shutdown NVML driver. Error code (cf. nvml.h): " << std::to_string(ret) << flush;
+	dlclose(nvml_so_handle_);
+}
+
+
+shared_ptr<NvmlInterface> NvmlInterface::instance()
+{
+	shared_ptr<NvmlInterface> rv;
+	if (instance_.expired()) {
+		rv.reset(new NvmlInterface());
+		instance_ = rv;
+	}
+	else
+		rv = instance_.lock();
+
+	return rv;
+}
+
+
+size_t NvmlInterface::add_device(const string &bus_id)
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	nvmlReturn_t ret;
+
+	if (!nvml_initialized_) {
+		if ((ret = dl_nvmlInit_v2()))
+			throw SystemError("Failed to initialize NVML driver. Error code (cf. nvml.h): " + std::to_string(ret));
+		nvml_initialized_ = true;
+	}
+
+	size_t free_slot = devices_.size();
+	for (size_t i = 0; i < devices_.size(); ++i) {
+		if (devices_[i].users && devices_[i].bus_id == bus_id) {
+			++devices_[i].users;
+			return i;
+		}
+		else if (!devices_[i].users)
+			free_slot = std::min(free_slot, i);
+	}
+
+	nvmlDevice_t handle;
+	if ((ret = dl_nvmlDeviceGetHandleByPciBusId_v2(bus_id.c_str(), &handle)))
+		throw SystemError("Failed to open PCI device " + bus_id + ". Error code (cf. nvml.h): " + std::to_string(ret));
+
+	string name;
+	name.resize(256);
+	dl_nvmlDeviceGetName(handle, &*name.begin(), 255);
+	log(TF_DBG) << "Initialized NVML sensor on " << name.c_str() << " at PCI " << bus_id << "." << flush;
+
+	Device dev { bus_id, 1, handle, NVML_SUCCESS, 0, 0 };
+	if (free_slot < devices_.size())
+		devices_[free_slot] = dev;
+	else
+		devices_.push_back(dev);
+
+	return free_slot;
+}
+
+
+void NvmlInterface::release_device(size_t device)
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	--devices_[device].users;
+}
+
+
+void NvmlInterface::read_all()
+{
+	const unsigned long pass = SensorSweep::pass();
+	for (Device &dev : devices_) {
+		if (dev.users) {
+			dev.ret = dl_nvmlDeviceGetTemperature(dev.handle, NVML_TEMPERATURE_GPU, &dev.temp);
+			dev.pass = pass;
+		}
+	}
+}
+
+
+IOStatus NvmlInterface::get_temp(size_t device, unsigned int &temp)
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	Device &dev = devices_[device];
+
+	// Only a read from the current sweep is fresh. That also holds when another GPU's driver did it,
+	// or when this one skipped some sweeps because of its interval.
+	if (dev.pass != SensorSweep::pass())
+		read_all();
+
+	if (dev.ret)
+		return IOStatus::system_error(MSG_T_GET(dev.bus_id) + "Error code (cf. nvml.h): " + std::to_string(dev.ret));
+	temp = dev.temp;
+	return IOStatus();
+}
+
+
+}
+
+#endif /* USE_NVML */
@@ -0,0 +1,85 @@
+/********************************************************************
+ * nvml.h: State management for the nVidia Management Library
+ * (C) 2026, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+#pragma once
+
+#include "thinkfan.h"
+
+#ifdef USE_NVML
+#include <nvidia/gdk/nvml.h>
+
+namespace thinkfan {
+
+/** @brief Loads and initializes libnvidia-ml.so once for all NVML sensors.
+ *  Each NvmlSensorDriver registers its GPU with add_device(). The first get_temp() in a sweep (cf.
+ *  SensorSweep::pass()) reads the temperatures of all registered GPUs at once, the others in the
+ *  same sweep get the values from that read.
+ *  All public methods may be called from worker threads (cf. SensorSweep). */
+class NvmlInterface
+{
+public:
+	~NvmlInterface();
+	NvmlInterface(const NvmlInterface &) = delete;
+	NvmlInterface(NvmlInterface &&) = delete;
+
+	static shared_ptr<NvmlInterface> instance();
+
+	/// @return A handle for get_temp() and release_device()
+	size_t add_device(const string &bus_id);
+	void release_device(size_t device);
+
+	IOStatus get_temp(size_t device, unsigned int &temp);
+
+private:
+	NvmlInterface();
+
+	void read_all();
+
+	struct Device {
+		string bus_id;
+		// Number of drivers that use this device, 0 if the slot is free
+		unsigned int users;
+		nvmlDevice_t handle;
+		nvmlReturn_t ret;
+		unsigned int temp;
+		// SensorSweep::pass() of the last read, 0 if it hasn't been read yet
+		unsigned long pass;
+	};
+
+	static std::weak_ptr<NvmlInterface> instance_;
+
+	vector<Device> devices_;
+	std::mutex mutex_;
+	bool nvml_initialized_;
+	void *nvml_so_handle_;
+
+	// Pointers to dynamically loaded functions from libnvidia-ml.so
+	nvmlReturn_t (*dl_nvmlInit_v2)();
+	nvmlReturn_t (*dl_nvmlDeviceGetHandleByPciBusId_v2)(const char *, nvmlDevice_t *);
+	nvmlReturn_t (*dl_nvmlDeviceGetName)(nvmlDevice_t, char *, unsigned int);
+	nvmlReturn_t (*dl_nvmlDeviceGetTemperature)(nvmlDevice_t, nvmlTemperatureSensors_t, unsigned int *);
+	nvmlReturn_t (*dl_nvmlShutdown)();
+};
+
+
+}
+
+#endif /* USE_NVML */
@@ -0,0 +1,195 @@
+/********************************************************************
+ * persistent_file.cpp: Keep sysfs/procfs attributes open across reads
+ * (C) 2026, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+#include "persistent_file.h"
+#include "error.h"
+#include "message.h"
+
+#include <unistd.h>
+#include <cerrno>
+#include <charconv>
+
+namespace thinkfan {
+
+
+PersistentFile::PersistentFile()
+: flags_(O_RDONLY)
+, fd_(-1)
+{}
+
+
+PersistentFile::~PersistentFile()
+{ close(); }
+
+
+void PersistentFile::open(const string &path, int flags)
+{
+	close();
+	path_ = path;
+	flags_ = flags;
+	if (int err = reopen())
+		throw IOerror(string(__func__) + ": Opening " + path_ + ": ", err);
+}
+
+
+int PersistentFile::reopen() noexcept
+{
+	close();
+	fd_ = ::open(path_.c_str(), flags_ | O_CLOEXEC);
+	return fd_ < 0 ? errno : 0;
+}
+
+
+void PersistentFile::close()
+{
+	if (fd_ >= 0) {
+		::close(fd_);
+		fd_ = -1;
+	}
+}
+
+
+bool PersistentFile::is_open() const
+{ return fd_ >= 0; }
+
+int PersistentFile::fd() const
+{ return fd_; }
+
+const string &PersistentFile::path() const
+{ return path_; }
+
+
+ssize_t PersistentFile::try_read(char *buf, size_t len) noexcept
+{
+	int err;
+	if (unlikely(fd_ < 0) && (err = reopen()))
+		return -err;
+
+	ssize_t rv = ::pread(fd_, buf, len, 0);
+	if (unlikely(rv < 0 && (errno == ENODEV || errno == ESTALE))) {
+		if ((err = reopen()))
+			return -err;
+		rv = ::pread(fd_, buf, len, 0);
+	}
+
+	return rv < 0 ? -errno : rv;
+}
+
+
+int PersistentFile::try_read_int(int &value) noexcept
+{
+	// Enough for any int plus sign & newline
+	char buf[24];
+	ssize_t len = try_read(buf, sizeof(buf));
+	if (unlikely(len < 0))
+		return int(-len);
+
+	const char *pos = buf;
+	if (unlikely(!parse_int(pos, buf + len, value)))
+		return EINVAL;
+
+	return 0;
+}
+
+
+int PersistentFile::try_write(const char *buf, size_t len) noexcept
+{
+	int err;
+	if (unlikely(fd_ < 0) && (err = reopen()))
+		return err;
+
+	ssize_t rv = ::pwrite(fd_, buf, len, 0);
+	if (unlikely(rv < 0 && (errno == ENODEV || errno == ESTALE))) {
+		if ((err = reopen()))
+			return err;
+		rv = ::pwrite(fd_, buf, len, 0);
+	}
+
+	return rv < 0 ? errno : 0;
+}
+
+
+int PersistentFile::try_write_int(int value) noexcept
+{
+	char buf[24];
+	auto result = std::to_chars(buf, buf + sizeof(buf) - 1, value);
+	*result.ptr++ = '\n';
+	return try_write(buf, size_t(result.ptr - buf));
+}
+
+
+size_t PersistentFile::read(char *buf, size_t len)
+{
+	ssize_t rv = try_read(buf, len);
+	if (unlikely(rv < 0))
+		throw IOerror(MSG_T_GET(path_), int(-rv));
+	return size_t(rv);
+}
+
+
+int PersistentFile::read_int()
+{
+	int rv;
+	if (int err = try_read_int(rv))
+		throw IOerror(MSG_T_GET(path_), err);
+	return rv;
+}
+
+
+void PersistentFile::write(const char *buf, size_t len)
+{
+	if (int err = try_write(buf, len))
+		throw IOerror("Writing to " + path_ + ": ", err);
+}
+
+
+void PersistentFile::write_int(int value)
+{
+	if (int err = try_write_int(value))
+		throw IOerror("Writing to " + path_ + ": ", err);
+}
+
+
+bool PersistentFile::parse_int(const char *&pos, const char *end, int &value)
+{
+	while (pos < end && (*pos == ' ' || *pos == '\t' || *pos == '\n'))
+		++pos;
+
+	bool negative = false;
+	if (pos < end && (*pos == '-' || *pos == '+'))
+		negative = *pos++ == '-';
+
+	if (unlikely(pos >= end || unsigned(*pos - '0') > 9))
+		return false;
+
+	long long v = 0;
+	for (; pos < end && unsigned(*pos - '0') <= 9; ++pos) {
+		v = v * 10 + (*pos - '0');
+		if (unlikely(v > numeric_limits<int>::max()))
+			return false;
+	}
+
+	value = static_cast<int>(negative ? -v : v);
+	return true;
+}
+
+
+} // namespace thinkfan
@@ -0,0 +1,85 @@
+#pragma once
+
+/********************************************************************
+ * persistent_file.h: Keep sysfs/procfs attributes open across reads
+ * (C) 2026, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+#include "thinkfan.h"
+
+#include <fcntl.h>
+
+namespace thinkfan {
+
+
+/** @brief A file descriptor that stays open for the lifetime of a driver.
+ *  Kernel attribute files (sysfs, procfs) regenerate their content on every read from offset 0,
+ *  so we can just pread() them over and over instead of paying for open()/close() and iostream
+ *  setup on every cycle. */
+class PersistentFile {
+public:
+	PersistentFile();
+	PersistentFile(const PersistentFile &) = delete;
+	PersistentFile &operator = (const PersistentFile &) = delete;
+	~PersistentFile();
+
+	/// @brief (Re-)open @a path, closing any previously opened file. Throws IOerror on failure.
+	void open(const string &path, int flags = O_RDONLY);
+	void close();
+
+	bool is_open() const;
+	int fd() const;
+	const string &path() const;
+
+	/** @brief Read the file from offset 0 into @a buf with a single pread().
+	 *  If the kernel says the open file is stale (ENODEV, ESTALE), e.g. because the device has been
+	 *  re-bound, the file is re-opened and the read is retried once.
+	 *  @return The number of bytes read, or -errno on failure. */
+	ssize_t try_read(char *buf, size_t len) noexcept;
+
+	/// @brief Read a single (possibly signed) decimal integer, as found in most sysfs attributes.
+	/// @return 0 on success, an errno value otherwise.
+	int try_read_int(int &value) noexcept;
+
+	/// @brief Write @a buf at offset 0 with a single pwrite(). Re-opens stale files like try_read().
+	/// @return 0 on success, an errno value otherwise.
+	int try_write(const char *buf, size_t len) noexcept;
+	int try_write_int(int value) noexcept;
+
+	// Same as above, but throw an IOerror on failure
+	size_t read(char *buf, size_t len);
+	int read_int();
+	void write(const char *buf, size_t len);
+	void write_int(int value);
+
+	/** @brief Parse a decimal integer from @a buf without locale or allocation overhead.
+	 *  Leading whitespace is skipped. @a pos is advanced past the last digit.
+	 *  @return false if there was no number at @a pos. */
+	static bool parse_int(const char *&pos, const char *end, int &value);
+
+private:
+	int reopen() noexcept;
+
+	string path_;
+	int flags_;
+	int fd_;
+};
+
+
+} // namespace thinkfan
@@ -0,0 +1,420 @@
+/********************************************************************
+ * sensor_sweep.cpp: Read all configured sensors once per cycle
+ * (C) 2026, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+#include "sensor_sweep.h"
+#include "sensors.h"
+#include "message.h"
+
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <typeinfo>
+
+namespace thinkfan {
+
+
+std::atomic<unsigned long> SensorSweep::pass_(1);
+
+
+SensorSweep::SensorSweep(const vector<unique_ptr<SensorDriver>> &sensors)
+: sensors_(sensors)
+, due_(sensors.size(), true)
+, is_async_(sensors.size(), false)
+, stop_(false)
+#ifdef USE_IO_URING
+, ring_ok_(false)
+, batched_(false)
+#endif
+{
+	for (size_t i = 0; i < sensors_.size(); ++i) {
+		const std::type_info &type = typeid(*sensors_[i]);
+		if (type == typeid(HwmonSensorDriver))
+			hwmon_sensors_.push_back(i);
+		else if (type == typeid(TpSensorDriver))
+			tp_sensors_.push_back(i);
+#ifdef USE_ATASMART
+		else if (type == typeid(AtasmartSensorDriver))
+			atasmart_sensors_.push_back(i);
+#endif
+#ifdef USE_NVML
+		else if (type == typeid(NvmlSensorDriver))
+			nvml_sensors_.push_back(i);
+#endif
+#ifdef USE_LM_SENSORS
+		else if (type == typeid(LMSensorsDriver))
+			lm_sensors_.push_back(i);
+#endif
+		else
+			other_sensors_.push_back(i);
+	}
+
+	init_async();
+#ifdef USE_IO_URING
+	init_batch();
+#endif
+}
+
+
+SensorSweep::~SensorSweep()
+{
+	stop_async();
+#ifdef USE_IO_URING
+	disable_batch();
+#endif
+}
+
+
+unsigned long SensorSweep::pass()
+{ return pass_; }
+
+
+void SensorSweep::read_temps()
+{
+	++pass_;
+
+	auto now = std::chrono::steady_clock::now();
+	auto deadline = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(secondsf(async_deadline));
+
+	// due() schedules the next read, so it's only asked when a read can actually start. For the
+	// worker pool, that's decided in start_async_reads().
+	for (size_t i = 0; i < sensors_.size(); ++i)
+		if (!is_async_[i])
+			due_[i] = sensors_[i]->due(now);
+
+	start_async_reads(now);
+
+#ifdef USE_IO_URING
+	batched_ = ring_ok_ && read_batched();
+#endif
+
+	read_groups();
+
+	finish_async_reads(deadline);
+}
+
+
+void SensorSweep::read_groups()
+{
+	read_group<HwmonSensorDriver>(hwmon_sensors_);
+	read_group<TpSensorDriver>(tp_sensors_);
+#ifdef USE_ATASMART
+	read_group<AtasmartSensorDriver>(atasmart_sensors_);
+#endif
+#ifdef USE_NVML
+	read_group<NvmlSensorDriver>(nvml_sensors_);
+#endif
+#ifdef USE_LM_SENSORS
+	read_group<LMSensorsDriver>(lm_sensors_);
+#endif
+	read_group<SensorDriver>(other_sensors_);
+}
+
+
+template<class DriverT>
+void SensorSweep::read_group(const vector<size_t> &group)
+{
+	for (size_t i : group) {
+		DriverT &sensor = static_cast<DriverT &>(*sensors_[i]);
+
+		if (is_async_[i])
+			continue;
+		else if (!due_[i])
+			sensor.skip_temps();
+#ifdef USE_IO_URING
+		else if (batched_ && slot_idx_[i] >= 0 && slots_[size_t(slot_idx_[i])].fd >= 0) {
+			BatchSlot &slot = slots_[size_t(slot_idx_[i])];
+			if (unlikely(slot.result == -ENODEV || slot.result == -ESTALE)) {
+				// The sequential read path re-opens the file. Force re-registering it in the next
+				// cycle because the new fd may well have the same number as the stale one.
+				slot.fd = -1;
+				sensor.template read_temps_as<DriverT>();
+			}
+			else
+				sensor.template read_temps_as<DriverT>(slot.buf.data(), slot.result);
+		}
+#endif
+		else
+			sensor.template read_temps_as<DriverT>();
+	}
+}
+
+
+void SensorSweep::init_async()
+{
+	if (async_deadline <= 0)
+		return;
+
+	for (size_t i = 0; i < sensors_.size(); ++i) {
+		if (sensors_[i]->slow()) {
+			jobs_.push_back({ i, AsyncJob::IDLE, false });
+			is_async_[i] = true;
+		}
+	}
+
+	for (size_t i = 0; i < std::min(jobs_.size(), max_workers); ++i)
+		workers_.emplace_back(&SensorSweep::worker, this);
+}
+
+
+void SensorSweep::stop_async()
+{
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		stop_ = true;
+		queue_.clear();
+	}
+	work_cond_.notify_all();
+
+	// Running reads can't be interrupted, so this may block until they're done.
+	for (std::thread &t : workers_)
+		t.join();
+	workers_.clear();
+}
+
+
+void SensorSweep::worker()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (true) {
+		work_cond_.wait(lock, [this] () {
+			return stop_ || !queue_.empty();
+		} );
+		if (stop_)
+			return;
+
+		AsyncJob &job = jobs_[queue_.front()];
+		queue_.pop_front();
+		job.state = AsyncJob::RUNNING;
+
+		lock.unlock();
+		sensors_[job.sensor_idx]->read_temps_staged();
+		lock.lock();
+
+		job.state = AsyncJob::DONE;
+		done_cond_.notify_all();
+	}
+}
+
+
+bool SensorSweep::busy_with_same_type(const SensorDriver &sensor) const
+{
+	// Drivers of the same type may share library state (e.g. libsensors), so we must not
+	// (re-)initialize one while another one is being read.
+	for (const AsyncJob &job : jobs_)
+		if ((job.state == AsyncJob::QUEUED || job.state == AsyncJob::RUNNING)
+				&& typeid(*sensors_[job.sensor_idx]) == typeid(sensor))
+			return true;
+	return false;
+}
+
+
+void SensorSweep::start_async_reads(std::chrono::steady_clock::time_point now)
+{
+	if (jobs_.empty())
+		return;
+
+	std::unique_lock<std::mutex> lock(mutex_);
+
+	for (size_t i = 0; i < jobs_.size(); ++i) {
+		AsyncJob &job = jobs_[i];
+		SensorDriver &sensor = *sensors_[job.sensor_idx];
+		job.handled = false;
+
+		if (job.state != AsyncJob::IDLE)
+			// Either still running from a previous cycle, or done but not yet committed
+			continue;
+
+		due_[job.sensor_idx] = sensor.due(now);
+		if (!due_[job.sensor_idx]) {
+			lock.unlock();
+			sensor.skip_temps();
+			lock.lock();
+			job.handled = true;
+		}
+		else if (sensor.available() && sensor.initialized()) {
+			job.state = AsyncJob::QUEUED;
+			queue_.push_back(i);
+		}
+		else if (!busy_with_same_type(sensor)) {
+			// Initialization has to happen on the main thread since it logs and may touch shared
+			// library state. Not having to wait for it is the normal case.
+			lock.unlock();
+			sensor.read_temps();
+			lock.lock();
+			job.handled = true;
+		}
+		else {
+			lock.unlock();
+			sensor.skip_temps();
+			lock.lock();
+			job.handled = true;
+		}
+	}
+
+	work_cond_.notify_all();
+}
+
+
+void SensorSweep::finish_async_reads(std::chrono::steady_clock::time_point deadline)
+{
+	if (jobs_.empty())
+		return;
+
+	std::unique_lock<std::mutex> lock(mutex_);
+
+	done_cond_.wait_until(lock, deadline, [this] () {
+		for (const AsyncJob &job : jobs_)
+			if (job.state == AsyncJob::QUEUED || job.state == AsyncJob::RUNNING)
+				return false;
+		return true;
+	} );
+
+	for (AsyncJob &job : jobs_) {
+		if (job.handled)
+			continue;
+
+		SensorDriver &sensor = *sensors_[job.sensor_idx];
+		if (job.state == AsyncJob::DONE) {
+			// The worker is done with this sensor, so we can safely touch it without holding the lock
+			lock.unlock();
+			sensor.commit_staged_temps();
+			lock.lock();
+			job.state = AsyncJob::IDLE;
+		}
+		else {
+			lock.unlock();
+			log(TF_INF) << sensor.path() << ": Reading is late, keeping last temperature." << flush;
+			sensor.skip_temps();
+			lock.lock();
+		}
+	}
+}
+
+
+#ifdef USE_IO_URING
+
+void SensorSweep::init_batch()
+{
+	for (size_t i = 0; i < sensors_.size(); ++i) {
+		if (sensors_[i]->batch_file()) {
+			slot_idx_.push_back(static_cast<long>(slots_.size()));
+			slots_.push_back({ i, -1, 0, {} });
+		}
+		else
+			slot_idx_.push_back(-1);
+	}
+
+	// Nothing to gain from batching a single read
+	if (slots_.size() < 2)
+		return;
+
+	int err = ::io_uring_queue_init(static_cast<unsigned int>(slots_.size()), &ring_, 0);
+	if (err < 0) {
+		log(TF_INF) << "io_uring is not available (" << std::strerror(-err)
+			<< "), reading sensors sequentially." << flush;
+		return;
+	}
+
+	// Start out with an empty (sparse) file table. The fds are filled in as the sensors become
+	// available, see read_batched().
+	vector<int> fds(slots_.size(), -1);
+	err = ::io_uring_register_files(&ring_, fds.data(), static_cast<unsigned int>(fds.size()));
+	if (err < 0) {
+		log(TF_INF) << "Cannot register files with io_uring (" << std::strerror(-err)
+			<< "), reading sensors sequentially." << flush;
+		::io_uring_queue_exit(&ring_);
+		return;
+	}
+
+	ring_ok_ = true;
+	log(TF_DBG) << "Reading " << static_cast<unsigned int>(slots_.size())
+		<< " sensors in a batch via io_uring." << flush;
+}
+
+
+void SensorSweep::disable_batch()
+{
+	if (ring_ok_) {
+		::io_uring_queue_exit(&ring_);
+		ring_ok_ = false;
+	}
+}
+
+
+bool SensorSweep::read_batched()
+{
+	unsigned int queued = 0;
+	int err;
+
+	for (size_t i = 0; i < slots_.size(); ++i) {
+		BatchSlot &slot = slots_[i];
+		SensorDriver &sensor = *sensors_[slot.sensor_idx];
+		PersistentFile *file = sensor.batch_file();
+
+		int fd = (sensor.available() && sensor.initialized() && file->is_open()) ? file->fd() : -1;
+		if (unlikely(fd != slot.fd)) {
+			if ((err = ::io_uring_register_files_update(&ring_, static_cast<unsigned int>(i), &fd, 1)) < 0) {
+				log(TF_WRN) << "io_uring_register_files_update: " << std::strerror(-err)
+					<< ". Falling back to sequential sensor reads." << flush;
+				disable_batch();
+				return false;
+			}
+			slot.fd = fd;
+		}
+		if (fd < 0 || !due_[slot.sensor_idx])
+			continue;
+
+		::io_uring_sqe *sqe = ::io_uring_get_sqe(&ring_);
+		::io_uring_prep_read(sqe, static_cast<int>(i), slot.buf.data(), static_cast<unsigned int>(slot.buf.size()), 0);
+		sqe->flags |= IOSQE_FIXED_FILE;
+		sqe->user_data = i;
+		++queued;
+	}
+
+	if (queued) {
+		if ((err = ::io_uring_submit_and_wait(&ring_, queued)) < 0) {
+			log(TF_WRN) << "io_uring_submit_and_wait: " << std::strerror(-err)
+				<< ". Falling back to sequential sensor reads." << flush;
+			disable_batch();
+			return false;
+		}
+
+		for (unsigned int reaped = 0; reaped < queued; ++reaped) {
+			::io_uring_cqe *cqe;
+			if ((err = ::io_uring_wait_cqe(&ring_, &cqe)) < 0) {
+				log(TF_WRN) << "io_uring_wait_cqe: " << std::strerror(-err)
+					<< ". Falling back to sequential sensor reads." << flush;
+				disable_batch();
+				return false;
+			}
+			slots_[cqe->user_data].result = cqe->res;
+			::io_uring_cqe_seen(&ring_, cqe);
+		}
+	}
+
+	// The results are picked up by read_groups()
+	return true;
+}
+
+#endif // USE_IO_URING
+
+
+} // namespace thinkfan
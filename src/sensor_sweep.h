@@ -0,0 +1,142 @@
+#pragma once
+
+/********************************************************************
+ * sensor_sweep.h: Read all configured sensors once per cycle
+ * (C) 2026, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+#include "thinkfan.h"
+
+#include <array>
+#include <deque>
+#include <thread>
+
+#ifdef USE_IO_URING
+#include <liburing.h>
+#endif
+
+namespace thinkfan {
+
+
+/** @brief Reads all sensors of a config.
+ *  Sensors are read in groups of the same concrete driver type, so each group is a tight loop
+ *  without virtual calls. Every sensor still reports to its own slots in the TemperatureState, so
+ *  the temperatures stay in config order.
+ *  If thinkfan is built with USE_IO_URING and the kernel lets us use it, all sensors that read a
+ *  single file (see SensorDriver::batch_file()) are read in one batch of io_uring reads on
+ *  registered fds. All other sensors, and all sensors when io_uring isn't available, are read one
+ *  after the other.
+ *  If an @a async_deadline is set (option -a), slow sensors (see SensorDriver::slow()) are read by
+ *  a pool of worker threads instead. Whatever hasn't arrived when the deadline expires is
+ *  considered stale, i.e. the last known temperature is kept, and picked up in the next cycle. */
+class SensorSweep {
+public:
+	SensorSweep(const vector<unique_ptr<SensorDriver>> &sensors);
+	SensorSweep(const SensorSweep &) = delete;
+	~SensorSweep();
+
+	void read_temps();
+
+	/// @return The number of the sweep that is currently being read. Readings taken while this
+	/// stays the same belong to the same cycle. Starts at 1, i.e. before the first sweep.
+	static unsigned long pass();
+
+private:
+	void read_groups();
+
+	template<class DriverT>
+	void read_group(const vector<size_t> &group);
+
+	void init_async();
+	void start_async_reads(std::chrono::steady_clock::time_point now);
+	void finish_async_reads(std::chrono::steady_clock::time_point deadline);
+	void stop_async();
+	void worker();
+	bool busy_with_same_type(const SensorDriver &sensor) const;
+
+	static std::atomic<unsigned long> pass_;
+
+	const vector<unique_ptr<SensorDriver>> &sensors_;
+	// Per sensor: whether it is read in the current cycle (cf. SensorDriver::due())
+	vector<bool> due_;
+
+	// Indices into sensors_, grouped by concrete driver type
+	vector<size_t> hwmon_sensors_;
+	vector<size_t> tp_sensors_;
+#ifdef USE_ATASMART
+	vector<size_t> atasmart_sensors_;
+#endif
+#ifdef USE_NVML
+	vector<size_t> nvml_sensors_;
+#endif
+#ifdef USE_LM_SENSORS
+	vector<size_t> lm_sensors_;
+#endif
+	// Anything we don't know is read through the vtable
+	vector<size_t> other_sensors_;
+
+	// At most this many threads in the worker pool
+	static constexpr size_t max_workers = 8;
+
+	struct AsyncJob {
+		// Index into sensors_
+		size_t sensor_idx;
+		enum { IDLE, QUEUED, RUNNING, DONE } state;
+		// Has been read synchronously or skipped in this cycle
+		bool handled;
+	};
+
+	vector<AsyncJob> jobs_;
+	// Per sensor: whether it is read by the worker pool
+	vector<bool> is_async_;
+	std::deque<size_t> queue_;
+	vector<std::thread> workers_;
+	std::mutex mutex_;
+	std::condition_variable work_cond_;
+	std::condition_variable done_cond_;
+	bool stop_;
+
+#ifdef USE_IO_URING
+	static constexpr size_t max_read_size = 256;
+
+	void init_batch();
+	bool read_batched();
+	void disable_batch();
+
+	struct BatchSlot {
+		// Index into sensors_
+		size_t sensor_idx;
+		// The fd registered for this slot, -1 if the sensor can't be batched right now
+		int fd;
+		int result;
+		std::array<char, max_read_size> buf;
+	};
+
+	::io_uring ring_;
+	bool ring_ok_;
+	// The batch has been read in the current cycle
+	bool batched_;
+	vector<BatchSlot> slots_;
+	// Per sensor: index into slots_ or -1
+	vector<long> slot_idx_;
+#endif
+};
+
+
+} // namespace thinkfan
@@ -27,10 +27,9 @@
 #include <cstring>
 #include <typeinfo>
 #include <cmath>
+#include <algorithm>
+#include <utility>
 
-#ifdef USE_NVML
-#include <dlfcn.h>
-#endif
 
 namespace thinkfan {
 
@@ -43,28 +42,13 @@ SensorDriver::SensorDriver(bool optional, opt<vector<int>> correction, opt<unsig
 : Driver(optional, max_errors.value_or(0))
 , correction_(correction.value_or(vector<int>()))
 , num_temps_(0)
+, staging_(false)
 {}
 
-void SensorDriver::init()
-{ readstream(path()); }
-
 SensorDriver::~SensorDriver() noexcept(false)
 {}
 
 
-inline int SensorDriver::readstream(const string &path) {
-	std::ifstream f(path);
-	if (!(f.is_open() && f.good()))
-		throw IOerror(MSG_T_GET(path), errno);
-
-	int tmp;
-	if (!(f >> tmp))
-		throw IOerror(MSG_T_GET(path), errno);
-
-	return tmp;
-}
-
-
 void SensorDriver::set_correction(const vector<int> &correction)
 {
 	correction_ = correction;
@@ -72,6 +56,10 @@ void SensorDriver::set_correction(const vector<int> &correction)
 }
 
 
+const vector<int> &SensorDriver::correction() const
+{ return correction_; }
+
+
 void SensorDriver::set_num_temps(unsigned int n)
 {
 	num_temps_ = n;
@@ -91,11 +79,84 @@ bool SensorDriver::operator == (const SensorDriver &other) const
 
 
 void SensorDriver::read_temps()
+{ read_temps_as<SensorDriver>(); }
+
+void SensorDriver::read_temps(const char *buf, ssize_t result)
+{ read_temps_as<SensorDriver>(buf, result); }
+
+bool SensorDriver::slow() const
+{ return false; }
+
+
+void SensorDriver::read_temps_staged()
+{
+	staged_temps_.clear();
+	staged_status_ = IOStatus();
+	staged_error_ = nullptr;
+	staging_ = true;
+	try {
+		staged_status_ = read_temps_();
+	} catch (...) {
+		staged_error_ = std::current_exception();
+	}
+	staging_ = false;
+}
+
+
+void SensorDriver::commit_staged_temps()
 {
 	temp_state_.restart();
-	robust_io(&SensorDriver::read_temps_);
+	robust_op(
+		[&] () {
+			if (staged_error_)
+				std::rethrow_exception(std::exchange(staged_error_, nullptr));
+			if (unlikely(!staged_status_.ok()))
+				return std::exchange(staged_status_, IOStatus());
+			for (int t : staged_temps_)
+				temp_state_.add_temp(t);
+			return IOStatus();
+		},
+		[&] (const IOStatus &e) {
+			skip_io_error(e);
+		}
+	);
+}
+
+
+void SensorDriver::skip_temps()
+{
+	temp_state_.restart();
+	for (unsigned int i = 0; i < num_temps(); ++i)
+		temp_state_.skip_temp();
+}
+
+
+void SensorDriver::set_interval(seconds interval)
+{ interval_ = interval; }
+
+
+bool SensorDriver::due(std::chrono::steady_clock::time_point now)
+{
+	if (!interval_ || !initialized() || !available())
+		return true;
+	if (now < next_read_)
+		return false;
+
+	next_read_ = now + *interval_;
+	return true;
 }
 
+
+IOStatus SensorDriver::read_error(int error_code) const
+{ return IOStatus::io_error(MSG_T_GET(path()), error_code); }
+
+
+PersistentFile *SensorDriver::batch_file()
+{ return nullptr; }
+
+IOStatus SensorDriver::parse_temps_(const char *, size_t)
+{ throw Bug(type_name() + " does not support batched reads"); }
+
 void SensorDriver::init_temp_state_ref(TemperatureState::Ref &&ref)
 { temp_state_ = std::move(ref); }
 
@@ -109,7 +170,7 @@ void SensorDriver::check_correction_length()
 }
 
 
-void SensorDriver::skip_io_error(const ExpectedError &e)
+void SensorDriver::skip_io_error(const IOStatus &e)
 {
 	if (this->optional()) {
 		log(TF_INF) << DriverLost(e).what();
@@ -158,17 +219,32 @@ HwmonSensorDriver::HwmonSensorDriver(
 
 void HwmonSensorDriver::init()
 {
-	SensorDriver::init();
+	file_.open(path());
+	file_.read_int();
 	set_num_temps(1);
 }
 
-void HwmonSensorDriver::read_temps_()
+IOStatus HwmonSensorDriver::read_temps_()
 {
-	temp_state_.add_temp(
-		readstream(path()) / 1000 + correction_[0]
-	);
+	int tmp;
+	if (int err = file_.try_read_int(tmp))
+		return IOStatus::io_error(MSG_T_GET(path()), err);
+	temp_state_.add_temp(tmp / 1000 + correction_[0]);
+	return IOStatus();
+}
+
+IOStatus HwmonSensorDriver::parse_temps_(const char *buf, size_t len)
+{
+	int tmp;
+	if (unlikely(!PersistentFile::parse_int(buf, buf + len, tmp)))
+		return IOStatus::io_error(MSG_T_GET(path()), EINVAL);
+	temp_state_.add_temp(tmp / 1000 + correction_[0]);
+	return IOStatus();
 }
 
+PersistentFile *HwmonSensorDriver::batch_file()
+{ return &file_; }
+
 
 
 string HwmonSensorDriver::lookup()
@@ -193,42 +269,58 @@ TpSensorDriver::TpSensorDriver(
 	opt<unsigned int> max_errors
 )
 : SensorDriver(optional, correction, max_errors)
+, skip_bytes_(0)
 , temp_indices_(temp_indices)
 , conf_path_(conf_path)
+, last_read_time_(0)
+, max_read_time_(0)
 {
 	if (temp_indices_)
 		set_num_temps(static_cast<unsigned int>(temp_indices_->size()));
 }
 
 
-void TpSensorDriver::init()
+ssize_t TpSensorDriver::read_file(char *buf)
 {
-	int tmp;
-	unsigned int count = 0;
+	clock::time_point t0 = clock::now();
+	ssize_t len = file_.try_read(buf, max_file_size_);
+	last_read_time_ = clock::now() - t0;
+
+	if (unlikely(last_read_time_ > max_read_time_)) {
+		max_read_time_ = last_read_time_;
+		log(TF_DBG) << path() << ": Slowest read so far took "
+			<< std::to_string(std::chrono::duration_cast<std::chrono::microseconds>(max_read_time_).count())
+			<< " us." << flush;
+	}
 
-	string skip;
-	skip.resize(skip_prefix_.size());
+	return len;
+}
 
-	std::ifstream f(path());
-	if (!(f.is_open() && f.good()))
-		throw IOerror(MSG_SENSOR_INIT(path()), errno);
 
-	if (!f.get(&*skip.begin(), static_cast<std::streamsize>(skip_prefix_.size() + 1)))
-		throw IOerror(MSG_SENSOR_INIT(path()), errno);
+void TpSensorDriver::init()
+{
+	char buf[max_file_size_];
+	unsigned int count = 0;
+	int tmp;
 
-	if (skip == skip_prefix_)
-		skip_bytes_ = f.tellg();
+	file_.open(path());
+	ssize_t rv = read_file(buf);
+	if (rv < 0)
+		throw IOerror(MSG_SENSOR_INIT(path()), int(-rv));
+	size_t len = size_t(rv);
+	if (len >= max_file_size_)
+		throw IOerror(MSG_SENSOR_INIT(path()), EOVERFLOW);
+
+	if (len > skip_prefix_.size() && skip_prefix_.compare(0, skip_prefix_.size(), buf, skip_prefix_.size()) == 0)
+		skip_bytes_ = skip_prefix_.size();
 	else
 		throw SystemError(path() + ": Unknown file format.");
 
-	while (!(f.eof() || f.fail())) {
-		f >> tmp;
-		if (f.bad())
-			throw IOerror(MSG_T_GET(path()), errno);
-		if (!f.fail())
-			++count;
-	}
+	const char *pos = buf + skip_bytes_;
+	while (PersistentFile::parse_int(pos, buf + len, tmp))
+		++count;
 
+	in_use_.clear();
 	if (temp_indices_) {
 		if (temp_indices_->size() > count)
 			throw ConfigError(
@@ -237,41 +329,70 @@ void TpSensorDriver::init()
 				+ ", but there are only " + std::to_string(count) + "."
 			);
 
-
-		in_use_ = vector<bool>(count, false);
-		for (unsigned int i : *temp_indices_)
-			in_use_[i] = true;
+		for (unsigned int i : *temp_indices_) {
+			if (i >= count)
+				throw ConfigError(
+					"Temperature index " + std::to_string(i) + " is out of range in " + path()
+					+ ", which has only " + std::to_string(count) + " temperatures."
+				);
+			in_use_.push_back(i);
+		}
+		std::sort(in_use_.begin(), in_use_.end());
+		in_use_.erase(std::unique(in_use_.begin(), in_use_.end()), in_use_.end());
 	}
 	else {
-		in_use_ = vector<bool>(count, true);
+		for (unsigned int i = 0; i < count; ++i)
+			in_use_.push_back(i);
 		set_num_temps(count);
 	}
 }
 
 
-void TpSensorDriver::read_temps_()
+IOStatus TpSensorDriver::read_temps_()
 {
-	std::ifstream f(path());
-	if (!(f.is_open() && f.good()))
-		throw IOerror(MSG_T_GET(path()), errno);
+	char buf[max_file_size_];
+	ssize_t len = read_file(buf);
+	if (unlikely(len < 0))
+		return IOStatus::io_error(MSG_T_GET(path()), int(-len));
+	return parse_temps_(buf, size_t(len));
+}
 
-	f.seekg(skip_bytes_);
-	if (f.fail())
-		throw IOerror(MSG_T_GET(path()), errno);
 
+IOStatus TpSensorDriver::parse_temps_(const char *buf, size_t len)
+{
+	if (unlikely(len >= max_file_size_))
+		return IOStatus::io_error(MSG_T_GET(path()), EOVERFLOW);
+	if (unlikely(len < skip_bytes_))
+		return IOStatus::io_error(MSG_T_GET(path()), EINVAL);
+
+	const char *pos = buf + skip_bytes_;
+	const char *end = buf + len;
 	unsigned int tidx = 0;
 	unsigned int cidx = 0;
-	int tmp;
-	while (!(f.eof() || f.fail())) {
-		f >> tmp;
-		if (f.bad())
-			throw IOerror(MSG_T_GET(path()), errno);
-		if (!f.fail() && in_use_[tidx++])
-			temp_state_.add_temp(tmp + correction_[cidx++]);
+	int tmp = 0;
+
+	for (unsigned int idx : in_use_) {
+		// Skip over the unused temperatures up to and including the next one we want
+		for (; tidx <= idx; ++tidx)
+			if (unlikely(!PersistentFile::parse_int(pos, end, tmp)))
+				return IOStatus::io_error(MSG_T_GET(path()), EINVAL);
+		temp_state_.add_temp(tmp + correction_[cidx++]);
 	}
+
+	return IOStatus();
 }
 
 
+PersistentFile *TpSensorDriver::batch_file()
+{ return &file_; }
+
+TpSensorDriver::clock::duration TpSensorDriver::last_read_time() const
+{ return last_read_time_; }
+
+TpSensorDriver::clock::duration TpSensorDriver::max_read_time() const
+{ return max_read_time_; }
+
+
 string TpSensorDriver::lookup()
 {
 	std::ifstream f(conf_path_);
@@ -295,66 +416,168 @@ AtasmartSensorDriver::AtasmartSensorDriver(
 	string device_path,
 	bool optional,
 	opt<vector<int>> correction,
-	opt<unsigned int> max_errors
+	opt<unsigned int> max_errors,
+	opt<seconds> refresh_interval,
+	opt<seconds> max_age
 )
 : SensorDriver(optional, correction, max_errors)
+, disk_(nullptr)
 , device_path_(device_path)
+, refresh_interval_(refresh_interval)
+, max_age_(max_age.value_or(refresh_interval.value_or(seconds(0)) * 3))
+, stop_(false)
+, cached_temp_(0)
 {
 	set_num_temps(1);
 }
 
 void AtasmartSensorDriver::init()
 {
+	// May be called again after a reload or a failed optional init, so keep what's already set up.
+	if (disk_)
+		return;
+
 	if (sk_disk_open(path().c_str(), &disk_) < 0) {
+		disk_ = nullptr;
 		string msg = std::strerror(errno);
 		throw SystemError("sk_disk_open(" + path() + "): " + msg);
 	}
+
+	if (refresh_interval_) {
+		// Fill the cache synchronously so errors surface during initialization
+		IOStatus status = read_smart_temp(cached_temp_);
+		if (!status.ok()) {
+			sk_disk_free(disk_);
+			disk_ = nullptr;
+			status.raise();
+		}
+		cache_time_ = clock::now();
+		refresher_ = std::thread(&AtasmartSensorDriver::refresh_loop, this);
+		log(TF_DBG) << path() << ": Refreshing S.M.A.R.T. temperature every "
+			<< refresh_interval_->count() << " s." << flush;
+	}
 }
 
 
 AtasmartSensorDriver::~AtasmartSensorDriver()
-{ sk_disk_free(disk_); }
+{
+	stop_refresher();
+	if (disk_)
+		sk_disk_free(disk_);
+}
 
 
-void AtasmartSensorDriver::read_temps_()
+void AtasmartSensorDriver::stop_refresher()
+{
+	if (!refresher_.joinable())
+		return;
+
+	{
+		std::unique_lock<std::mutex> lock(cache_mutex_);
+		stop_ = true;
+	}
+	stop_cond_.notify_all();
+	refresher_.join();
+}
+
+
+void AtasmartSensorDriver::refresh_loop()
+{
+	// Runs on its own thread, so it must not log.
+	std::unique_lock<std::mutex> lock(cache_mutex_);
+	while (!stop_cond_.wait_for(lock, *refresh_interval_, [this] () { return stop_; })) {
+		lock.unlock();
+		int temp = 0;
+		IOStatus status = read_smart_temp(temp);
+		lock.lock();
+
+		if (status.ok()) {
+			cached_temp_ = temp;
+			cache_time_ = clock::now();
+			cache_error_.clear();
+		}
+		else
+			cache_error_ = status.what();
+	}
+}
+
+
+AtasmartSensorDriver::clock::duration AtasmartSensorDriver::cache_age() const
+{
+	if (!refresh_interval_)
+		return clock::duration::zero();
+
+	return clock::now() - cache_time_.load();
+}
+
+
+IOStatus AtasmartSensorDriver::read_temps_()
+{
+	if (!refresh_interval_) {
+		int temp;
+		IOStatus status = read_smart_temp(temp);
+		if (likely(status.ok()))
+			add_temp(temp);
+		return status;
+	}
+
+	std::unique_lock<std::mutex> lock(cache_mutex_);
+	clock::duration age = cache_age();
+	if (unlikely(age > max_age_)) {
+		string msg = MSG_T_GET(path()) + "Cached temperature is "
+			+ std::to_string(std::chrono::duration_cast<seconds>(age).count()) + " s old";
+		if (!cache_error_.empty())
+			msg += ". Last error: " + cache_error_;
+		return IOStatus::system_error(msg);
+	}
+	add_temp(cached_temp_);
+	return IOStatus();
+}
+
+
+IOStatus AtasmartSensorDriver::read_smart_temp(int &temp)
 {
 	SkBool disk_sleeping = false;
 
 	if (unlikely(dnd_disk && (sk_disk_check_sleep_mode(disk_, &disk_sleeping) < 0))) {
 		string msg = strerror(errno);
-		throw SystemError("sk_disk_check_sleep_mode(" + path() + "): " + msg);
+		return IOStatus::system_error("sk_disk_check_sleep_mode(" + path() + "): " + msg);
 	}
 
 	if (unlikely(disk_sleeping)) {
-		temp_state_.add_temp(0);
+		temp = 0;
+		return IOStatus();
 	}
-	else {
-		uint64_t mKelvin;
-		float tmp;
 
-		if (unlikely(sk_disk_smart_read_data(disk_) < 0)) {
-			string msg = strerror(errno);
-			throw SystemError("sk_disk_smart_read_data(" + path() + "): " + msg);
-		}
-		if (unlikely(sk_disk_smart_get_temperature(disk_, &mKelvin)) < 0) {
-			string msg = strerror(errno);
-			throw SystemError("sk_disk_smart_get_temperature(" + path() + "): " + msg);
-		}
+	uint64_t mKelvin;
+	float tmp;
 
-		tmp = mKelvin / 1000.0f;
-		tmp -= 273.15f;
+	if (unlikely(sk_disk_smart_read_data(disk_) < 0)) {
+		string msg = strerror(errno);
+		return IOStatus::system_error("sk_disk_smart_read_data(" + path() + "): " + msg);
+	}
+	if (unlikely(sk_disk_smart_get_temperature(disk_, &mKelvin)) < 0) {
+		string msg = strerror(errno);
+		return IOStatus::system_error("sk_disk_smart_get_temperature(" + path() + "): " + msg);
+	}
 
-		if (unlikely(tmp > std::floor(numeric_limits<int>::max()) || tmp < std::numeric_limits<int>::min())) {
-			throw SystemError(MSG_T_GET(path()) + std::to_string(tmp) + " isn't a valid temperature.");
-		}
+	tmp = mKelvin / 1000.0f;
+	tmp -= 273.15f;
 
-		temp_state_.add_temp(int(tmp) + correction_[0]);
+	if (unlikely(tmp > std::floor(numeric_limits<int>::max()) || tmp < std::numeric_limits<int>::min())) {
+		return IOStatus::system_error(MSG_T_GET(path()) + std::to_string(tmp) + " isn't a valid temperature.");
 	}
+
+	temp = int(tmp) + correction_[0];
+	return IOStatus();
 }
 
 string AtasmartSensorDriver::lookup()
 { return device_path_; }
 
+bool AtasmartSensorDriver::slow() const
+{ return !refresh_interval_; }
+
 string AtasmartSensorDriver::type_name() const
 { return "atasmart sensor driver"; }
 
@@ -370,72 +593,41 @@ string AtasmartSensorDriver::type_name() const
 NvmlSensorDriver::NvmlSensorDriver(string bus_id, bool optional, opt<vector<int>> correction, opt<unsigned int> max_errors)
 : SensorDriver(optional, correction, max_errors),
   bus_id_(bus_id),
-  dl_nvmlInit_v2(nullptr),
-  dl_nvmlDeviceGetHandleByPciBusId_v2(nullptr),
-  dl_nvmlDeviceGetName(nullptr),
-  dl_nvmlDeviceGetTemperature(nullptr),
-  dl_nvmlShutdown(nullptr)
+  nvml_(NvmlInterface::instance())
 {
-	if (!(nvml_so_handle_ = dlopen("libnvidia-ml.so.1", RTLD_LAZY))) {
-		string msg = strerror(errno);
-		throw SystemError("Failed to load libnvidia-ml.so.1: " + msg);
-	}
-
-	/* Apparently GCC doesn't want to cast to function pointers, so we have to do
-	 * this kind of weird stuff.
-	 * See http://stackoverflow.com/questions/1096341/function-pointers-casting-in-c
-	 */
-	*reinterpret_cast<void **>(&dl_nvmlInit_v2) = dlsym(nvml_so_handle_, "nvmlInit_v2");
-	*reinterpret_cast<void **>(&dl_nvmlDeviceGetHandleByPciBusId_v2) = dlsym(
-			nvml_so_handle_, "nvmlDeviceGetHandleByPciBusId_v2");
-	*reinterpret_cast<void **>(&dl_nvmlDeviceGetName) = dlsym(nvml_so_handle_, "nvmlDeviceGetName");
-	*reinterpret_cast<void **>(&dl_nvmlDeviceGetTemperature) = dlsym(nvml_so_handle_, "nvmlDeviceGetTemperature");
-	*reinterpret_cast<void **>(&dl_nvmlShutdown) = dlsym(nvml_so_handle_, "nvmlShutdown");
-
-	if (!(dl_nvmlDeviceGetHandleByPciBusId_v2 && dl_nvmlDeviceGetName &&
-			dl_nvmlDeviceGetTemperature && dl_nvmlInit_v2 && dl_nvmlShutdown))
-		throw SystemError("Incompatible NVML driver.");
 	set_num_temps(1);
 }
 
 
 void NvmlSensorDriver::init()
 {
-	nvmlReturn_t ret;
-	string name, brand;
-	name.resize(256);
-	brand.resize(256);
-
-	if ((ret = dl_nvmlInit_v2()))
-		throw SystemError("Failed to initialize NVML driver. Error code (cf. nvml.h): " + std::to_string(ret));
-	if ((ret = dl_nvmlDeviceGetHandleByPciBusId_v2(path().c_str(), &device_)))
-		throw SystemError("Failed to open PCI device " + path() + ". Error code (cf. nvml.h): " + std::to_string(ret));
-	dl_nvmlDeviceGetName(device_, &*name.begin(), 255);
-	log(TF_DBG) << "Initialized NVML sensor on " << name << " at PCI " << path() << "." << flush;
+	if (!device_)
+		device_ = nvml_->add_device(path());
 }
 
 
 NvmlSensorDriver::~NvmlSensorDriver() noexcept(false)
 {
-	nvmlReturn_t ret;
-	if ((ret = dl_nvmlShutdown()))
-		log(TF_ERR) << "Failed to shutdown NVML driver. Error code (cf. nvml.h): " << std::to_string(ret);
-	dlclose(nvml_so_handle_);
+	if (device_)
+		nvml_->release_device(*device_);
 }
 
 
-void NvmlSensorDriver::read_temps_()
+IOStatus NvmlSensorDriver::read_temps_()
 {
-	nvmlReturn_t ret;
-	unsigned int tmp;
-	if ((ret = dl_nvmlDeviceGetTemperature(device_, NVML_TEMPERATURE_GPU, &tmp)))
-		throw SystemError(MSG_T_GET(path()) + "Error code (cf. nvml.h): " + std::to_string(ret));
-	temp_state_.add_temp(int(tmp));
+	unsigned int temp;
+	IOStatus status = nvml_->get_temp(*device_, temp);
+	if (likely(status.ok()))
+		add_temp(int(temp));
+	return status;
 }
 
 string NvmlSensorDriver::lookup()
 { return bus_id_; }
 
+bool NvmlSensorDriver::slow() const
+{ return true; }
+
 string NvmlSensorDriver::type_name() const
 { return "NVML sensor driver"; }
 
@@ -459,14 +651,18 @@ LMSensorsDriver::LMSensorsDriver(
 )
 : SensorDriver(optional, correction, max_errors),
   chip_name_(chip_name),
-  feature_names_(feature_names)
+  feature_names_(feature_names),
+  temps_(feature_names_.size())
 {
 	set_num_temps(feature_names_.size());
 }
 
 
 LMSensorsDriver::~LMSensorsDriver()
-{}
+{
+	if (libsensors_iface_)
+		libsensors_iface_->remove_client(this);
+}
 
 const string &LMSensorsDriver::chip_name() const
 { return chip_name_; }
@@ -484,7 +680,10 @@ void LMSensorsDriver::init()
 // cost us an additional vtable lookup on every read_temps(), so we choose to manipulate
 // the state here.
 void LMSensorsDriver::set_unavailable()
-{ path_.reset(); }
+{
+	path_.reset();
+	chip_features_ = {};
+}
 
 
 string LMSensorsDriver::lookup()
@@ -494,21 +693,28 @@ string LMSensorsDriver::lookup()
 
 	// If a sensor is not found, uninit() is called on ALL OTHER LMSensorsDrivers
 	// instances and an exception is thrown.
-	return libsensors_iface_->lookup_client_features(this);
+	return libsensors_iface_->lookup_client_features(this, chip_features_);
 }
 
 
+bool LMSensorsDriver::slow() const
+{ return true; }
+
 string LMSensorsDriver::type_name() const
 { return "libsensors sensor driver"; }
 
 
-void LMSensorsDriver::read_temps_()
+IOStatus LMSensorsDriver::read_temps_()
 {
-	size_t index = 0;
-	for (double real_value : libsensors_iface_->get_temps(this))
-		temp_state_.add_temp(
-			int(real_value) + correction_[index++]
+	IOStatus status = libsensors_iface_->get_temps(chip_features_, chip_name_, temps_.data());
+	if (unlikely(!status.ok()))
+		return status;
+
+	for (size_t index = 0; index < temps_.size(); ++index)
+		add_temp(
+			int(temps_[index]) + correction_[index]
 		);
+	return IOStatus();
 }
 
 
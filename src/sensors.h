@@ -27,18 +27,20 @@
 #include "driver.h"
 #include "hwmon.h"
 #include "libsensors.h"
+#include "nvml.h"
+#include "persistent_file.h"
 #include "temperature_state.h"
 
 #ifdef USE_ATASMART
 #include <atasmart.h>
 #endif /* USE_ATASMART */
 
-#ifdef USE_NVML
-#include <nvidia/gdk/nvml.h>
-#endif /* USE_NVML */
 
 
 #include <optional>
+#include <exception>
+#include <thread>
+#include <sys/types.h>
 
 namespace thinkfan {
 
@@ -56,17 +58,65 @@ public:
 	virtual ~SensorDriver() noexcept(false) override;
 	unsigned int num_temps() const { return *num_temps_; }
 	void set_correction(const vector<int> &correction);
+	const vector<int> &correction() const;
 	bool operator == (const SensorDriver &other) const;
 
 	void read_temps();
+
+	/** @brief Like @a read_temps(), but use data that has already been read from @a batch_file(),
+	 *  e.g. by a batched io_uring sweep.
+	 *  @param result The number of bytes in @a buf, or a negative errno if the read failed. */
+	void read_temps(const char *buf, ssize_t result);
+
+	/** @brief Same as the read_temps() methods, but call @a DriverT's read_temps_() or parse_temps_()
+	 *  directly instead of through the vtable. @a DriverT must be the (final) dynamic type of this
+	 *  driver and declare SensorDriver a friend. */
+	template<class DriverT> void read_temps_as();
+	template<class DriverT> void read_temps_as(const char *buf, ssize_t result);
+
+	/** @return The file that this driver reads all of its temperatures from with a single pread(),
+	 *  or nullptr if the driver doesn't work that way. Only drivers that return a file here can
+	 *  be read in a batch. */
+	virtual PersistentFile *batch_file();
+
 	void init_temp_state_ref(TemperatureState::Ref &&);
 
+	/// @return Whether reading this sensor may take long enough to stall the control loop
+	virtual bool slow() const;
+
+	/** @brief Run read_temps_() without touching the TemperatureState, e.g. on a worker thread.
+	 *  The temperatures are kept in a staging buffer and any error is stored. Both are handed to the
+	 *  TemperatureState (or to the usual error handling) by @a commit_staged_temps(), which must run
+	 *  on the main thread. */
+	void read_temps_staged();
+	void commit_staged_temps();
+
+	/// @brief Keep the last known temperatures, e.g. because a reading didn't arrive in time.
+	void skip_temps();
+
+	/// @brief Read this sensor only every @a interval instead of in every cycle.
+	void set_interval(seconds interval);
+
+	/** @return Whether this sensor should be read in the cycle starting at @a now. If so, the next
+	 *  reading is scheduled. Sensors that aren't initialized yet are always due. */
+	bool due(std::chrono::steady_clock::time_point now);
+
 protected:
-	virtual void init() override;
+	/// @brief Report a temperature. Drivers whose slow() returns true must use this in read_temps_().
+	void add_temp(int t)
+	{
+		if (unlikely(staging_))
+			staged_temps_.push_back(t);
+		else
+			temp_state_.add_temp(t);
+	}
+
 	void set_num_temps(unsigned int n);
-	static inline int readstream(const string &path);
-	virtual void skip_io_error(const ExpectedError &e) override;
-	virtual void read_temps_() = 0;
+	virtual void skip_io_error(const IOStatus &e) override;
+	virtual IOStatus read_temps_() = 0;
+
+	/// @brief Parse the content of @a batch_file(). Must be implemented by drivers that have one.
+	virtual IOStatus parse_temps_(const char *buf, size_t len);
 
 	vector<int> correction_;
 	TemperatureState::Ref temp_state_;
@@ -76,10 +126,56 @@ protected:
 private:
 	opt<unsigned int> num_temps_;
 	void check_correction_length();
+	IOStatus read_error(int error_code) const;
+
+	bool staging_;
+	vector<int> staged_temps_;
+	IOStatus staged_status_;
+	std::exception_ptr staged_error_;
+
+	opt<seconds> interval_;
+	std::chrono::steady_clock::time_point next_read_;
 };
 
 
-class HwmonSensorDriver : public SensorDriver {
+template<class DriverT>
+void SensorDriver::read_temps_as()
+{
+	temp_state_.restart();
+
+	if (!available() || !initialized())
+		try_init();
+
+	if (initialized())
+		robust_op(
+			[this] () {
+				return static_cast<DriverT *>(this)->read_temps_();
+			},
+			[this] (const IOStatus &e) {
+				skip_io_error(e);
+			}
+		);
+}
+
+
+template<class DriverT>
+void SensorDriver::read_temps_as(const char *buf, ssize_t result)
+{
+	temp_state_.restart();
+	robust_op(
+		[&] () {
+			if (unlikely(result < 0))
+				return read_error(static_cast<int>(-result));
+			return static_cast<DriverT *>(this)->parse_temps_(buf, static_cast<size_t>(result));
+		},
+		[this] (const IOStatus &e) {
+			skip_io_error(e);
+		}
+	);
+}
+
+
+class HwmonSensorDriver final : public SensorDriver {
 public:
 	HwmonSensorDriver(const string &path, bool optional);
 
@@ -90,18 +186,23 @@ public:
 		opt<unsigned int> max_errors = nullopt
 	);
 
+	virtual PersistentFile *batch_file() override;
+
 protected:
+	friend SensorDriver;
 	virtual void init() override;
-	virtual void read_temps_() override;
+	virtual IOStatus read_temps_() override;
+	virtual IOStatus parse_temps_(const char *buf, size_t len) override;
 	virtual string lookup() override;
 	virtual string type_name() const override;
 
 private:
 	shared_ptr<HwmonInterface<SensorDriver>> hwmon_interface_;
+	PersistentFile file_;
 };
 
 
-class TpSensorDriver : public SensorDriver {
+class TpSensorDriver final : public SensorDriver {
 public:
 	TpSensorDriver(
 		string conf_path,
@@ -111,71 +212,126 @@ public:
 		opt<unsigned int> max_errors = nullopt
 	);
 
+	virtual PersistentFile *batch_file() override;
+
 protected:
+	friend SensorDriver;
 	virtual void init() override;
-	virtual void read_temps_() override;
+	virtual IOStatus read_temps_() override;
+	virtual IOStatus parse_temps_(const char *buf, size_t len) override;
 	virtual string lookup() override;
 	virtual string type_name() const override;
 
+public:
+	using clock = std::chrono::steady_clock;
+
+	/// @return How long the last read took. This goes through the EC, so it may be surprisingly slow.
+	/// Reads in an io_uring batch (see SensorSweep) aren't timed.
+	clock::duration last_read_time() const;
+	/// @return How long the slowest read so far took
+	clock::duration max_read_time() const;
+
 private:
-	std::char_traits<char>::off_type skip_bytes_;
+	// /proc/acpi/ibm/thermal has at most 16 temperatures, so this is plenty
+	static constexpr size_t max_file_size_ = 256;
+
+	ssize_t read_file(char *buf);
+
+	size_t skip_bytes_;
 	static const string skip_prefix_;
-	vector<bool> in_use_;
+
+	/// Ascending indices of the temperatures we actually use
+	vector<unsigned int> in_use_;
 	const opt<vector<unsigned int>> temp_indices_;
 	const string conf_path_;
+	PersistentFile file_;
+	clock::duration last_read_time_;
+	clock::duration max_read_time_;
 };
 
 
 #ifdef USE_ATASMART
-class AtasmartSensorDriver : public SensorDriver {
+/** @brief Reads the temperature of a disk via S.M.A.R.T.
+ *  Without a @a refresh_interval, the disk is queried in every cycle. Otherwise a background thread
+ *  queries it once per @a refresh_interval and read_temps() only looks at the cached value. If that
+ *  is older than @a max_age (default: 3 * @a refresh_interval), reading fails like any other sensor
+ *  error. */
+class AtasmartSensorDriver final : public SensorDriver {
 public:
-	AtasmartSensorDriver(string device_path, bool optional, opt<vector<int>> correction = nullopt, opt<unsigned int> max_errors = nullopt);
+	using clock = std::chrono::steady_clock;
+
+	AtasmartSensorDriver(
+		string device_path,
+		bool optional,
+		opt<vector<int>> correction = nullopt,
+		opt<unsigned int> max_errors = nullopt,
+		opt<seconds> refresh_interval = nullopt,
+		opt<seconds> max_age = nullopt
+	);
 	virtual ~AtasmartSensorDriver();
 
+	virtual bool slow() const override;
+
+	/// @return Time since the cached temperature was last refreshed, zero if there is no cache
+	clock::duration cache_age() const;
+
 protected:
+	friend SensorDriver;
 	virtual void init() override;
-	virtual void read_temps_() override;
+	virtual IOStatus read_temps_() override;
 	virtual string lookup() override;
 	virtual string type_name() const override;
 
 private:
+	IOStatus read_smart_temp(int &temp);
+	void refresh_loop();
+	void stop_refresher();
+
 	SkDisk *disk_;
 	const string device_path_;
+
+	const opt<seconds> refresh_interval_;
+	const seconds max_age_;
+
+	std::thread refresher_;
+	mutable std::mutex cache_mutex_;
+	std::condition_variable stop_cond_;
+	bool stop_;
+	int cached_temp_;
+	// Atomic so cache_age() doesn't need the lock, which the SIGUSR1 handler can't take
+	std::atomic<clock::time_point> cache_time_;
+	// Message of the last failed refresh, empty if it succeeded
+	string cache_error_;
 };
 #endif /* USE_ATASMART */
 
 
 #ifdef USE_NVML
-class NvmlSensorDriver : public SensorDriver {
+class NvmlSensorDriver final : public SensorDriver {
 public:
 	NvmlSensorDriver(string bus_id, bool optional, opt<vector<int>> correction = nullopt, opt<unsigned int> max_errors = nullopt);
 	virtual ~NvmlSensorDriver() noexcept(false) override;
 
+	virtual bool slow() const override;
+
 protected:
+	friend SensorDriver;
 	virtual void init() override;
-	virtual void read_temps_() override;
+	virtual IOStatus read_temps_() override;
 	virtual string lookup() override;
 	virtual string type_name() const override;
 
 private:
 	const string bus_id_;
-	nvmlDevice_t device_;
-	void *nvml_so_handle_;
-
-	// Pointers to dynamically loaded functions from libnvidia-ml.so
-	nvmlReturn_t (*dl_nvmlInit_v2)();
-	nvmlReturn_t (*dl_nvmlDeviceGetHandleByPciBusId_v2)(const char *, nvmlDevice_t *);
-	nvmlReturn_t (*dl_nvmlDeviceGetName)(nvmlDevice_t, char *, unsigned int);
-	nvmlReturn_t (*dl_nvmlDeviceGetTemperature)(nvmlDevice_t, nvmlTemperatureSensors_t, unsigned int *);
-	nvmlReturn_t (*dl_nvmlShutdown)();
-
+	shared_ptr<NvmlInterface> nvml_;
+	opt<size_t> device_;
 };
 #endif /* USE_NVML */
 
 
 #ifdef USE_LM_SENSORS
 
-class LMSensorsDriver : public SensorDriver {
+class LMSensorsDriver final : public SensorDriver {
 public:
 	LMSensorsDriver(
 		string chip_name,
@@ -190,9 +346,12 @@ public:
 	const vector<string> &feature_names() const;
 	void set_unavailable();
 
+	virtual bool slow() const override;
+
 protected:
+	friend SensorDriver;
 	virtual void init() override;
-	virtual void read_temps_() override;
+	virtual IOStatus read_temps_() override;
 	virtual string lookup() override;
 	virtual string type_name() const override;
 
@@ -200,6 +359,9 @@ private:
 	const string chip_name_;
 	const std::vector<string> feature_names_;
 	shared_ptr<LibsensorsInterface> libsensors_iface_;
+	LibsensorsInterface::chip_features chip_features_;
+	// Preallocated for LibsensorsInterface::get_temps()
+	vector<double> temps_;
 };
 
 #endif /* USE_LM_SENSORS */
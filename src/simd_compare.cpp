@@ -0,0 +1,108 @@
+/********************************************************************
+ * simd_compare.cpp: Vectorized comparisons of temperatures against limits
+ * (C) 2026, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+#include "simd_compare.h"
+#include "temperature_state.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define THINKFAN_SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace thinkfan {
+
+
+// The SIMD versions process one lane_count block at a time and exit early after each block.
+static_assert(TemperatureState::lane_count % 16 == 0, "lane_count must be a multiple of the AVX2 width");
+
+
+static bool any_greater_equal_scalar(const int16_t *temps, const int16_t *limits, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+		if (temps[i] >= limits[i])
+			return true;
+	return false;
+}
+
+
+#ifdef THINKFAN_SIMD_X86
+
+__attribute__((target("sse2")))
+static bool any_greater_equal_sse2(const int16_t *temps, const int16_t *limits, size_t n)
+{
+	for (size_t block = 0; block < n; block += TemperatureState::lane_count) {
+		// All ones where temps < limits
+		__m128i less = _mm_set1_epi16(-1);
+		for (size_t i = block; i < block + TemperatureState::lane_count; i += 8) {
+			__m128i t = _mm_loadu_si128(reinterpret_cast<const __m128i *>(temps + i));
+			__m128i l = _mm_loadu_si128(reinterpret_cast<const __m128i *>(limits + i));
+			less = _mm_and_si128(less, _mm_cmplt_epi16(t, l));
+		}
+		if (_mm_movemask_epi8(less) != 0xFFFF)
+			return true;
+	}
+	return false;
+}
+
+
+__attribute__((target("avx2")))
+static bool any_greater_equal_avx2(const int16_t *temps, const int16_t *limits, size_t n)
+{
+	for (size_t block = 0; block < n; block += TemperatureState::lane_count) {
+		// All ones where temps < limits
+		__m256i less = _mm256_set1_epi16(-1);
+		for (size_t i = block; i < block + TemperatureState::lane_count; i += 16) {
+			__m256i t = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(temps + i));
+			__m256i l = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(limits + i));
+			less = _mm256_and_si256(less, _mm256_cmpgt_epi16(l, t));
+		}
+		if (_mm256_movemask_epi8(less) != -1)
+			return true;
+	}
+	return false;
+}
+
+#endif // THINKFAN_SIMD_X86
+
+
+using CompareFn = bool (*)(const int16_t *, const int16_t *, size_t);
+
+static CompareFn select_impl()
+{
+#ifdef THINKFAN_SIMD_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return any_greater_equal_avx2;
+	if (__builtin_cpu_supports("sse2"))
+		return any_greater_equal_sse2;
+#endif
+	return any_greater_equal_scalar;
+}
+
+
+bool any_greater_equal(const int16_t *temps, const int16_t *limits, size_t n)
+{
+	static const CompareFn impl = select_impl();
+	return impl(temps, limits, n);
+}
+
+
+} // namespace thinkfan
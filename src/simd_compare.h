@@ -0,0 +1,40 @@
+#pragma once
+
+/********************************************************************
+ * simd_compare.h: Vectorized comparisons of temperatures against limits
+ * (C) 2026, Victor Mataré
+ *
+ * this file is part of thinkfan. See thinkfan.c for further information.
+ *
+ * thinkfan is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * thinkfan is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with thinkfan.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * ******************************************************************/
+
+#include <cstddef>
+#include <cstdint>
+
+namespace thinkfan {
+
+
+/** @return Whether @a temps[i] >= @a limits[i] for any i < @a n.
+ *  @a n must be a multiple of TemperatureState::lane_count, i.e. both arrays must be padded such
+ *  that the padding never compares true. Uses AVX2 or SSE2 if the CPU has it. */
+bool any_greater_equal(const int16_t *temps, const int16_t *limits, size_t n);
+
+/// @return Whether @a temps[i] < @a limits[i] for all i < @a n. Same requirements as above.
+inline bool all_less(const int16_t *temps, const int16_t *limits, size_t n)
+{ return !any_greater_equal(temps, limits, n); }
+
+
+} // namespace thinkfan
@@ -21,97 +21,220 @@
 
 #include "temperature_state.h"
 #include "error.h"
-#include <cmath>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <utility>
 
 namespace thinkfan {
 
 
+// Arena alignment, i.e. one cache line
+static constexpr size_t arena_align = 64;
+
+static constexpr int bias_one = 1 << TemperatureState::bias_frac_bits;
+static constexpr int bias_max = std::numeric_limits<int16_t>::max();
+static constexpr int16_t temp_pad = std::numeric_limits<int16_t>::min();
+
+
+static uint64_t next_generation()
+{
+	static uint64_t generation = 0;
+	return ++generation;
+}
+
+
 TemperatureState::TemperatureState(unsigned int num_temps)
-: temps_(num_temps, 0),
-  biases_(num_temps, 0),
-  biased_temps_(num_temps, 0),
-  refd_temps_(0),
-  tmax(biased_temps_.begin())
-{}
+: arena_(nullptr)
+, refd_temps_(0)
+{ allocate(num_temps); }
+
+
+TemperatureState::TemperatureState(TemperatureState &&other)
+: size_(other.size_)
+, stride_(other.stride_)
+, arena_(std::exchange(other.arena_, nullptr))
+, temps_(other.temps_)
+, prev_temps_(other.prev_temps_)
+, biases_(other.biases_)
+, biased_temps_(other.biased_temps_)
+, updated_(other.updated_)
+, tmax_(other.tmax_)
+, generation_(other.generation_)
+, aggregate_(std::move(other.aggregate_))
+, refd_temps_(other.refd_temps_)
+{ other.allocate(0); }
+
+
+TemperatureState &TemperatureState::operator = (TemperatureState &&other)
+{
+	std::swap(size_, other.size_);
+	std::swap(stride_, other.stride_);
+	std::swap(arena_, other.arena_);
+	std::swap(temps_, other.temps_);
+	std::swap(prev_temps_, other.prev_temps_);
+	std::swap(biases_, other.biases_);
+	std::swap(biased_temps_, other.biased_temps_);
+	std::swap(updated_, other.updated_);
+	std::swap(tmax_, other.tmax_);
+	std::swap(generation_, other.generation_);
+	std::swap(aggregate_, other.aggregate_);
+	std::swap(refd_temps_, other.refd_temps_);
+	return *this;
+}
+
+
+TemperatureState::~TemperatureState()
+{ std::free(arena_); }
+
+
+void TemperatureState::allocate(unsigned int num_temps)
+{
+	std::free(arena_);
+
+	size_ = num_temps;
+	// At least one lane so the pointers are always valid
+	stride_ = std::max((num_temps + lane_count - 1) / lane_count, 1u) * lane_count;
+
+	size_t bytes = 5 * stride_ * sizeof(int16_t);
+	arena_ = static_cast<int16_t *>(std::aligned_alloc(arena_align, bytes));
+	if (!arena_)
+		throw std::bad_alloc();
+	std::memset(arena_, 0, bytes);
+
+	temps_ = arena_;
+	prev_temps_ = temps_ + stride_;
+	biases_ = prev_temps_ + stride_;
+	biased_temps_ = biases_ + stride_;
+	updated_ = biased_temps_ + stride_;
+
+	// The padding must never win a comparison
+	std::fill(biased_temps_ + size_, biased_temps_ + stride_, temp_pad);
+	tmax_ = size_ ? 0 : temp_pad;
+	// Never the same as in the previous arena, so nobody mistakes it for unchanged
+	generation_ = next_generation();
+	aggregate_ = Aggregate();
+}
+
 
 TemperatureState::Ref::Ref(TemperatureState &ts, unsigned int offset)
-: temp0_(ts.temps_.begin() + offset),
-  bias0_(ts.biases_.begin() + offset),
-  biased_temp0_(ts.biased_temps_.begin() + offset),
-  temp_(temp0_),
-  bias_(bias0_),
-  biased_temp_(biased_temp0_),
-  tstate_(&ts)
+: tstate_(&ts)
+, offset_(offset)
+, idx_(offset)
 {}
 
 
-
 TemperatureState::Ref::Ref()
+: tstate_(nullptr)
+, offset_(0)
+, idx_(0)
 {}
 
 void TemperatureState::Ref::restart()
+{ idx_ = offset_; }
+
+
+void TemperatureState::Ref::add_temp(int t)
 {
-	temp_ = temp0_;
-	bias_ = bias0_;
-	biased_temp_ = biased_temp0_;
+	tstate_->temps_[idx_] = int16_t(std::clamp(t, temp_min, temp_max));
+	tstate_->updated_[idx_] = 1;
+	skip_temp();
 }
 
+void TemperatureState::Ref::skip_temp()
+{ ++idx_; }
 
-void TemperatureState::Ref::add_temp(int t)
+
+void TemperatureState::update()
 {
-	int diff = *temp_ > 0 ?
-		t - *temp_
-		: 0;
-	*temp_ = t;
+	// Bias per degree of temperature change, in fixed point
+	const int level = int(bias_level * bias_one);
+	unsigned int jumps = 0, steady = 0;
+	int tmax = temp_pad;
+	int changed = 0;
+
+	// Written so the compiler can vectorize it: No branches or early exits, selections are done
+	// by multiplying with 0/1 conditions. updated_ is always 0 or 1.
+	for (unsigned int i = 0; i < stride_; ++i) {
+		const int t = temps_[i];
+		const int prev = prev_temps_[i];
+		const int bias = biases_[i];
+		const int updated = updated_[i];
+
+		const int diff = (t - prev) * (prev > 0);
+		const int jump = updated & (diff > 2);
+
+		// Apply bias if temperature changed quickly, otherwise slowly reduce it
+		const int sign = (bias > 0) - (bias < 0);
+		const int abs_bias = bias * sign;
+		const int decayed = (abs_bias >= bias_one / 2) * (bias - sign * (bias_one + abs_bias / 5));
+		const int jumped = std::min(std::max(diff * level, -bias_max), bias_max);
+		const int new_bias = jump * jumped + (1 - jump) * (updated * decayed + (1 - updated) * bias);
+
+		biases_[i] = int16_t(new_bias);
+		prev_temps_[i] = int16_t(updated * t + (1 - updated) * prev);
+		updated_[i] = 0;
+
+		jumps += unsigned(jump);
+		steady += unsigned(updated & !jump);
+	}
 
-	if (unlikely(diff > 2)) {
-		// Apply bias_ if temperature changed quickly
-		*bias_ = int(float(diff) * bias_level);
+	if (aggregate_.kind() != Aggregate::MAX) {
+		// Separate loop so the one below still vectorizes in the default case
+		for (unsigned int i = 0; i < size_; ++i) {
+			int biased = biased_temp(i);
+			if (biased != biased_temps_[i])
+				aggregate_.replace(i, biased_temps_[i], biased);
+		}
+	}
+
+	for (unsigned int i = 0; i < size_; ++i) {
+		const int biased = biased_temp(i);
+		changed |= biased != biased_temps_[i];
+		biased_temps_[i] = int16_t(biased);
+		tmax = std::max(tmax, int(biased_temps_[i]));
+	}
+	tmax_ = tmax;
+	if (changed)
+		generation_ = next_generation();
 
+	if (jumps) {
 		if (tmp_sleeptime > seconds(2))
 			tmp_sleeptime = seconds(2);
 	}
-	else {
-		// Slowly return to normal sleeptime
-		if (unlikely(tmp_sleeptime < sleeptime))
-			tmp_sleeptime++;
-		// slowly reduce the bias_
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wfloat-equal" // bias is set to 0 explicitly
-		if (unlikely(*bias_ != 0)) {
-#pragma GCC diagnostic pop
-			if (std::abs(*bias_) < 0.5f)
-				*bias_ = 0;
-			else
-				*bias_ -= std::copysign(1 + std::abs(*bias_)/5, *bias_);
-		}
+	else if (tmp_sleeptime < sleeptime) {
+		// Slowly return to normal sleeptime, one step per steady reading
+		tmp_sleeptime = std::min(tmp_sleeptime + seconds(steady), sleeptime);
 	}
+}
 
-	*biased_temp_ = *temp_ + int(*bias_);
-
-	if (*biased_temp_ > *tstate_->tmax)
-		tstate_->tmax = biased_temp_;
 
-	skip_temp();
-}
+int TemperatureState::biased_temp(unsigned int idx) const
+{ return std::clamp(temps_[idx] + biases_[idx] / bias_one, temp_min, temp_max); }
 
-void TemperatureState::Ref::skip_temp()
-{
-	++temp_;
-	++bias_;
-	++biased_temp_;
-}
 
+int TemperatureState::bias(unsigned int idx) const
+{ return biases_[idx] / bias_one; }
 
 
-const vector<int> & TemperatureState::biased_temps() const
-{ return biased_temps_; }
+void TemperatureState::set_aggregate(const Aggregate &aggregate)
+{
+	aggregate.ensure_consistency(size_);
+	aggregate_ = aggregate;
+	aggregate_.reset(biased_temps_, size_);
+}
 
-const vector<int> & TemperatureState::temps() const
-{ return temps_; }
 
-const vector<float> & TemperatureState::biases() const
-{ return biases_; }
+int TemperatureState::aggregate() const
+{
+	if (aggregate_.kind() == Aggregate::MAX)
+		return tmax_;
+	else
+		return aggregate_.value();
+}
 
 void TemperatureState::reset_refd_count()
 { refd_temps_ = 0; }
@@ -119,7 +242,7 @@ void TemperatureState::reset_refd_count()
 
 TemperatureState::Ref TemperatureState::ref(unsigned int num_temps)
 {
-	if (refd_temps_ + num_temps > temps_.size())
+	if (refd_temps_ + num_temps > size_)
 		throw Bug("Attempting to reference uninitialized temperature state");
 
 	auto ref = TemperatureState::Ref(*this, refd_temps_);
@@ -22,14 +22,34 @@
  * ******************************************************************/
 
 #include "thinkfan.h"
+#include "aggregate.h"
+
+#include <cstdint>
 
 namespace thinkfan {
 
 
+/** @brief The temperatures of all sensors in config order, plus their biases.
+ *  Everything lives in one cache-line aligned arena of int16_t arrays, each padded to a multiple
+ *  of @a lane_count elements so they can be processed in whole SIMD vectors:
+ *  - The raw temperatures as reported by the sensors (°C)
+ *  - The temperatures from the previous update()
+ *  - The biases in fixed point with @a bias_frac_bits fractional bits
+ *  - The biased temperatures, which are what the levels are compared against
+ *  - A mask of the temperatures that have been reported since the last update()
+ *  Sensors only store raw temperatures through their Ref. All the bias math happens in one pass
+ *  over the arrays in update(), which must be called after every sensor sweep. update() also keeps
+ *  the configured Aggregate up to date with the biased temperatures that have changed, and bumps
+ *  the generation() if there were any. */
 class TemperatureState {
 public:
-	template<typename T>
-	using Iter = typename vector<T>::iterator;
+	static constexpr unsigned int bias_frac_bits = 4;
+	static constexpr unsigned int lane_count = 32;
+
+	// All (biased) temperatures are clamped to this range, so they can't ever reach a limit that
+	// has been clamped to the range of int16_t.
+	static constexpr int temp_min = -32766;
+	static constexpr int temp_max = 32766;
 
 	class Ref {
 	public:
@@ -42,35 +62,62 @@ public:
 		friend TemperatureState;
 		Ref(TemperatureState &ts, unsigned int offset);
 
-		Iter<int> temp0_;
-		Iter<float> bias0_;
-		Iter<int> biased_temp0_;
-
-		Iter<int> temp_;
-		Iter<float> bias_;
-		Iter<int> biased_temp_;
-
 		TemperatureState *tstate_;
+		unsigned int offset_;
+		unsigned int idx_;
 	};
 
 	TemperatureState(unsigned int num_temps);
-
-	const vector<int> &biased_temps() const;
-	const vector<int> &temps() const;
-	const vector<float> &biases() const;
+	TemperatureState(TemperatureState &&);
+	TemperatureState &operator = (TemperatureState &&);
+	TemperatureState(const TemperatureState &) = delete;
+	~TemperatureState();
+
+	/// @brief Compute biases, biased temperatures and tmax() from the temperatures reported since
+	/// the last call.
+	void update();
+
+	unsigned int size() const { return size_; }
+	/// @return Number of elements in each array, including the padding
+	unsigned int padded_size() const { return stride_; }
+
+	const int16_t *temps() const { return temps_; }
+	const int16_t *biased_temps() const { return biased_temps_; }
+	/// @return The integer part of the bias on temperature @a idx
+	int bias(unsigned int idx) const;
+	int tmax() const { return tmax_; }
+
+	/// @return A number that changes whenever update() has changed any biased temperature, so
+	/// anything that only depends on biased_temps() needs to be recomputed only when it changes.
+	uint64_t generation() const { return generation_; }
+
+	/// @brief Use @a aggregate for aggregate() from now on. Must be consistent with size().
+	void set_aggregate(const Aggregate &aggregate);
+	/// @return The configured aggregate over all biased temperatures, by default tmax().
+	int aggregate() const;
 
 	Ref ref(unsigned int num_temps);
 
 	void reset_refd_count();
 
 private:
-	vector<int> temps_;
-	vector<float> biases_;
-	vector<int> biased_temps_;
+	void allocate(unsigned int num_temps);
+	int biased_temp(unsigned int idx) const;
+
+	unsigned int size_;
+	unsigned int stride_;
+	int16_t *arena_;
+
+	int16_t *temps_;
+	int16_t *prev_temps_;
+	int16_t *biases_;
+	int16_t *biased_temps_;
+	int16_t *updated_;
+
+	int tmax_;
+	uint64_t generation_;
+	Aggregate aggregate_;
 	unsigned int refd_temps_;
-
-public:
-	vector<int>::const_iterator tmax;
 };
 
 
@@ -3,11 +3,12 @@
 thinkfan \- A simple fan control program
 .SH SYNOPSIS
 .SY thinkfan
-.OP \-hnqDd
+.OP \-hnqeDd
 .OP \-b BIAS
 .OP \-c CONFIG
 .OP \-s SECONDS
 .OP \-p \fR[\fIDELAY\fR]\fI
+.OP \-a \fR[\fIDEADLINE\fR]\fI
 .YS
 
 
@@ -120,7 +121,25 @@ Show a short help message
 
 .TP
 .BI \-s " SECONDS"
-Maximum seconds between temperature updates (default: 5)
+Maximum seconds between temperature updates (default: 5, at most 15, or 60
+with \fB\-e\fR)
+
+.TP
+.B \-e
+Wake up before the cycle time is over when the hardware reports a temperature
+event, so a longer cycle time (\fB\-s\fR) can be used without reacting late to
+temperature spikes.
+For every hwmon sensor that has a writable \fBtemp*_max\fR and a
+\fBtemp*_max_alarm\fR (or \fBtemp*_alarm\fR) attribute, thinkfan sets
+\fBtemp*_max\fR just below the upper limit of the current fan level (or, for a
+fan curve, the temperature where the curve rises above the current PWM value)
+and waits for the alarm.
+The original \fBtemp*_max\fR values are restored on exit.
+Additionally, thinkfan wakes up on any uevent from the thermal subsystem, e.g.
+when a thermal zone crosses a trip point.
+This can't be used with fans that have a
+.B pid:
+section.
 
 .TP
 .BI \-b " BIAS"
@@ -190,6 +209,16 @@ displayed/logged.
 .BR "\-p " [\fISECONDS\fR]
 Use the pulsing\-fan workaround (for older Thinkpads). Takes an optional
 floating\-point argument (0\-10s) as depulsing duration. Default 0.5s.
+In every cycle in which the fan level doesn't change, the fan is disengaged for
+that long and then set back to its level. This doesn't delay the next cycle.
+
+.TP
+.BR "\-a " [\fISECONDS\fR]
+Read slow sensors (\fBchip:\fR, \fBnvml:\fR and \fBatasmart:\fR entries) in
+background threads so they can't delay fan control. Takes an optional
+floating\-point argument (0\-10s) as the time to wait for their readings in
+each cycle. A sensor that hasn't delivered by then keeps its last temperature
+for that cycle, and its reading is used in the next cycle. Default 0.5s.
 
 .TP
 .B \-d
@@ -213,6 +242,12 @@ config, we keep the old one.
 .P
 SIGUSR1 causes thinkfan to dump all currently known temperatures either to
 syslog, or to the console (if running with the \-n option).
+For each fan, it also reports in how many cycles the fan levels didn't have to
+be checked because the temperatures hadn't changed.
+For each tpacpi sensor, it reports how long the last and the slowest read of
+the thermal file took, since these go through the embedded controller.
+For each atasmart sensor with a refresh_interval, it reports how old the cached
+temperature is.
 .P
 SIGPWR tells thinkfan that the system is about to go to sleep. Thinkfan will
 then allow sensor read errors for the next 4 loops because many sensors will
@@ -56,6 +56,14 @@ tolerate different amounts of heat.
 Under each of these sections, there must be a list of key-value maps, each of
 which configures a sensor driver, fan driver or fan speed mapping.
 
+Optionally, an
+.B aggregate:
+entry selects what a \*(lqsimple mapping\*(rq compares its limits against
+(see
+.B Aggregate
+under
+.BR "FAN SPEEDS" ).
+
 
 .SH SENSOR & FAN DRIVERS
 
@@ -104,6 +112,8 @@ The syntax for identifying each type of sensors looks as follows:
 \f[CB]  \- nvml: \f[CI]nvml-bus-id\f[CR]          # Uses the proprietary nVidia driver
 
 \f[CB]  \- atasmart: \f[CI]disk-device-file\f[CR] # Requires libatasmart support
+\f[CB]    refresh_interval: \f[CI]refresh-seconds\f[CR] # Optional entry
+\f[CB]    max_age: \f[CI]max-age-seconds\f[CR]          # Optional entry
 
 \f[CB]  \- \f[CR]...
 \fR
@@ -120,6 +130,7 @@ behavior:
 \f[CB]    correction: \f[CI]correction-list\f[CR]  # Optional entry
 \f[CB]    optional: \f[CI]bool-ignore-errors\f[CR] # Optional entry
 \f[CB]    max_errors: \f[CI]num-max-errors\f[CR]   # Optional entry
+\f[CB]    interval: \f[CI]interval-seconds\f[CR]   # Optional entry
 \fR
 .fi
 
@@ -161,6 +172,9 @@ under the \fBlevels:\fR keyword:
 \f[CB]    optional: \f[CI]bool-ignore-errors\f[CR] # Optional entry
 \f[CB]    max_errors: \f[CI]num-max-errors\f[CR]   # Optional entry
 \f[CB]    levels: \f[CI]levels-section\f[CR]       # Optional entry
+\f[CB]    slew_rate: \f[CI]pwm-per-second\f[CR]   # Optional entry, hwmon only
+\f[CB]    pid: \f[CI]pid-section\f[CR]             # Optional entry, hwmon only
+\f[CB]    curve: \f[CI]curve-section\f[CR]         # Optional entry, hwmon only
 
 
 .SS Values
@@ -310,6 +324,21 @@ option in
 that prevents thinkfan from waking up sleeping (mechanical) disks to read their
 temperature.
 
+.TP
+.IR refresh-seconds " (optional, atasmart only)"
+Query the disk only every \fIrefresh-seconds\fR seconds in a background thread
+instead of in every cycle.
+Disk temperatures change slowly, and a S.M.A.R.T. query is a full round trip to
+the disk, so something like 60 seconds is usually good enough.
+Thinkfan then uses the last temperature that was read.
+
+.TP
+.IR max-age-seconds " (optional, 3 * \fIrefresh-seconds\fR by default)"
+If the background thread hasn't been able to read the disk temperature for
+longer than \fImax-age-seconds\fR, reading the sensor fails just like any
+other sensor error (cf. \fIbool-ignore-errors\fR and \fInum-max-errors\fR).
+Requires \fIrefresh-seconds\fR.
+
 .TP
 .IR correction-list " (optional, zeroes by default)"
 A YAML list that specifies temperature offsets for each sensor in use by the
@@ -348,6 +377,17 @@ When a device with a positive \fInum-max-errors\fR fails during runtime,
 thinkfan will likewise attempt to re-initialize it the given number of times
 before failing.
 
+.TP
+.IR interval-seconds " (optional, every cycle by default)"
+Read the sensor only every \fIinterval-seconds\fR seconds instead of in every
+cycle.
+In the cycles in between, thinkfan keeps using the last temperature that was
+read.
+This is useful for sensors whose temperature changes slowly (e.g. disks), while
+fast sensors (e.g. CPU packages) are still read in every cycle.
+Since sensors are only read at the beginning of a cycle, the effective interval
+is rounded up to the next cycle.
+
 .TP
 .IR levels-section " (optional, use global levels section by default)"
 As of thinkfan 2.0, multiple fans can be configured.
@@ -360,6 +400,28 @@ value(s) refer only the fans configured in that particular \fBfans:\fR entry.
 NOTE: Global and fan-specific \fBlevels:\fR are mutually exclusive, i.e.
 there cannot be both a global one and fan-specific sections.
 
+.TP
+.IR pid-section " (optional, hwmon fans only)"
+Instead of switching between levels, compute the fan's PWM value continuously
+with a PID controller (see \fBPID Control\fR under FAN SPEEDS below).
+
+.TP
+.IR pwm-per-second " (optional, hwmon fans only, unlimited by default)"
+Limit how fast the fan's PWM value may change.
+When the fan speed changes, the fan is ramped towards the new value in small
+steps between cycles, instead of jumping to it.
+It takes at most the difference divided by this rate (plus a fraction of a
+second) to get there.
+The decision of which speed to go to is not affected by this.
+
+.TP
+.IR curve-section " (optional, hwmon fans only)"
+Instead of switching between levels, interpolate the fan's PWM value on a
+curve (see \fBFan Curve\fR under FAN SPEEDS below).
+
+.PP
+A fan can only have one of \fBlevels:\fR, \fBpid:\fR and \fBcurve:\fR.
+
 
 .SH FAN SPEEDS
 
@@ -382,6 +444,12 @@ and
 .I upper-bound
 are compared only to the highest temperature found among all configured sensors.
 All other temperatures are ignored.
+The
+.B aggregate:
+entry can be used to compare against a different value computed from all
+temperatures instead (see
+.B Aggregate
+below).
 This mode is suitable for small systems (like laptops) where there is only one
 device (e.g. the CPU) whose temperature needs to be controlled, or where the
 required fan behaviour is similar enough for all heat-generating devices.
@@ -396,6 +464,162 @@ required fan behaviour is similar enough for all heat-generating devices.
 .fi
 
 
+.SS Aggregate
+The top-level
+.B aggregate:
+entry determines which single value the limits of a simple mapping are compared
+against.
+It has no effect on the detailed syntax.
+All temperatures have their
+.B correction
+and the bias (see
+.BR thinkfan (1))
+applied first.
+
+.nf
+\fC
+\f[CB]aggregate: max\f[CR]                      # The default
+\f[CB]aggregate: mean
+\f[CB]aggregate:
+\f[CB]  weighted_mean: [ \f[CI]w1\f[CB], \f[CI]w2\f[CB], \f[CR]...\f[CB] ]
+\f[CB]aggregate:
+\f[CB]  kth_largest: \f[CI]k\f[CR]
+\fR
+.fi
+
+.TP
+.B max
+The highest temperature.
+.TP
+.B mean
+The average of all temperatures, rounded to the nearest degree.
+.TP
+.BI weighted_mean: " \fR[ \fIw1\fR, \fIw2\fR, ... ]"
+The weighted average of all temperatures.
+There must be one non-negative weight for each temperature, in the same order
+as the temperatures in a detailed mapping, and at least one must be positive.
+A weight of
+.B 0
+excludes a temperature, which should be done for any
+.B optional
+sensor, because a missing sensor reports \-128\[char176]C.
+.TP
+.BI kth_largest: " k"
+The
+.IR k th
+highest temperature, i.e.
+.B kth_largest: 1
+is the same as
+.BR max .
+This can be used to ignore a single (or a few) misbehaving sensors.
+
+
+.SS PID Control
+An
+.B hwmon
+fan can be given a
+.B pid:
+section instead of levels.
+Then in every cycle, thinkfan computes a PWM value from how far the
+temperature is from a
+.IR setpoint ,
+how long it has been off, and how fast it is changing.
+This tracks the temperature more closely than levels do, without large
+steps in fan speed.
+The temperature is the same value that simple levels compare against, i.e. the
+highest temperature unless the
+.B aggregate:
+entry says otherwise (see
+.B Aggregate
+above).
+
+.nf
+\fC
+\f[CB]fans:
+\f[CB]  \- hwmon: \f[CI]hwmon-path
+\f[CB]    pid:
+\f[CB]      setpoint: \f[CI]temperature
+\f[CB]      kp: \f[CI]proportional-gain\f[CR]        # Optional entry
+\f[CB]      ki: \f[CI]integral-gain\f[CR]            # Optional entry
+\f[CB]      kd: \f[CI]derivative-gain\f[CR]          # Optional entry
+\f[CB]      min_output: \f[CI]pwm\f[CR]              # Optional entry, default 0
+\f[CB]      max_output: \f[CI]pwm\f[CR]              # Optional entry, default 255
+\f[CB]      min_delta: \f[CI]pwm\f[CR]               # Optional entry, default 1
+\fR
+.fi
+
+.TP
+.I setpoint
+The temperature (\[char176]C) to keep the fan at.
+.TP
+.IR proportional-gain ", " integral-gain ", " derivative-gain
+How much PWM is added per degree above the
+.IR setpoint ,
+per degree and second spent above it, and per degree per second of
+temperature rise, respectively.
+Below the setpoint, the same amounts are subtracted.
+They must not be negative, and at least one must be given.
+The integral only accumulates while the output isn't stuck at one of its limits.
+.TP
+.BR min_output ", " max_output
+The PWM range (0\-255) the output is clamped to.
+.TP
+.B min_delta
+The fan is only written when the output has changed by at least this much, or
+when it has reached
+.B min_output
+or
+.BR max_output .
+.PP
+Since a PID controller reacts to every temperature change, it can't be used
+together with event wakeups (the
+.B \-e
+option, see \fBthinkfan\fR(1)).
+
+
+.SS Fan Curve
+An
+.B hwmon
+fan can be given a
+.B curve:
+section instead of levels.
+It lists points of temperature and PWM value, and thinkfan sets the fan to
+the PWM value at the current temperature, interpolated linearly between the
+points.
+Below the first and above the last point, the PWM value of that point is used.
+Like for simple levels, the temperature is the highest one unless the
+.B aggregate:
+entry says otherwise (see
+.B Aggregate
+above).
+
+.nf
+\fC
+\f[CB]fans:
+\f[CB]  \- hwmon: \f[CI]hwmon-path
+\f[CB]    curve:
+\f[CB]      points:
+\f[CB]        \- [ \f[CI]temperature\f[CB], \f[CI]pwm\f[CB] ]
+\f[CB]        \- \f[CR]...
+\f[CB]      hysteresis: \f[CI]degrees\f[CR]          # Optional entry, default 0
+\fR
+.fi
+
+.TP
+.IR temperature ", " pwm
+At least two points are needed.
+The temperatures must be increasing, and the PWM values (0\-255) must not
+decrease.
+.TP
+.I degrees
+When the temperature falls, the fan only slows down once it has dropped this
+many degrees below where the curve would give the current PWM value.
+This keeps the fan from constantly changing speed when the temperature
+fluctuates by a degree or two.
+It must not be larger than the range between the first and the last
+.IR temperature .
+
+
 .SS Detailed Syntax
 This mode is suitable for more complex systems, with devices that have
 different temperature ratings.
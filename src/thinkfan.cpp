@@ -43,6 +43,8 @@
 #include "sensors.h"
 #include "fans.h"
 #include "temperature_state.h"
+#include "sensor_sweep.h"
+#include "event_wakeup.h"
 
 
 namespace thinkfan {
@@ -54,7 +56,11 @@ seconds sleeptime(5);
 seconds tmp_sleeptime = sleeptime;
 float bias_level(0);
 float depulse = 0;
+float async_deadline = 0;
+bool event_wakeups = false;
 static TemperatureState temp_state(0);
+// Only set while run() is active
+static const Config *running_config = nullptr;
 std::atomic<unsigned char> tolerate_errors(0);
 
 std::condition_variable sleep_cond;
@@ -124,8 +130,11 @@ void PidFileHolder::cleanup()
 
 
 void sleep(thinkfan::seconds duration) {
-	auto until = std::chrono::steady_clock::now() + duration;
+	sleep_until(std::chrono::steady_clock::now() + duration);
+}
+
 
+void sleep_until(std::chrono::steady_clock::time_point until) {
 	std::unique_lock<std::mutex> sleep_locked(sleep_mutex);
 	sleep_cond.wait_until(sleep_locked, until, [] () {
 		return interrupted != 0;
@@ -140,9 +149,34 @@ void sig_handler(int signum) {
 	case SIGTERM:
 		interrupted = signum;
 		sleep_cond.notify_all();
+		EventWakeup::notify();
 		break;
 	case SIGUSR1:
 		log(TF_NFY) << temp_state << flush;
+		if (running_config) {
+			for (const unique_ptr<FanConfig> &fan_cfg : running_config->fan_configs())
+				// Only mappings that can skip evaluations count them
+				if (fan_cfg->evaluations() + fan_cfg->skipped_evaluations() > 0)
+					log(TF_NFY) << MSG_SKIPPED_EVALS(fan_cfg->fan()->path(), fan_cfg->skipped_evaluations(),
+						fan_cfg->evaluations() + fan_cfg->skipped_evaluations()) << flush;
+
+			using std::chrono::duration_cast;
+			using std::chrono::microseconds;
+			for (const unique_ptr<SensorDriver> &sensor : running_config->sensors()) {
+				if (!sensor->initialized())
+					continue;
+				if (const TpSensorDriver *tp = dynamic_cast<const TpSensorDriver *>(sensor.get()))
+					log(TF_NFY) << MSG_TP_READ_TIME(tp->path(),
+						duration_cast<microseconds>(tp->last_read_time()).count(),
+						duration_cast<microseconds>(tp->max_read_time()).count()) << flush;
+#ifdef USE_ATASMART
+				else if (const AtasmartSensorDriver *ata = dynamic_cast<const AtasmartSensorDriver *>(sensor.get()))
+					// Zero means it's read directly, without a cache
+					if (ata->cache_age() != AtasmartSensorDriver::clock::duration::zero())
+						log(TF_NFY) << MSG_CACHE_AGE(ata->path(), duration_cast<seconds>(ata->cache_age()).count()) << flush;
+#endif /* USE_ATASMART */
+			}
+		}
 		break;
 #ifndef DISABLE_BUGGER
 	case SIGSEGV:
@@ -152,6 +186,7 @@ void sig_handler(int signum) {
 	case SIGUSR2:
 		interrupted = signum;
 		sleep_cond.notify_all();
+		EventWakeup::notify();
 		log(TF_NFY) << "Received SIGUSR2: Re-initializing fan control." << flush;
 		break;
 	case SIGPWR:
@@ -162,27 +197,68 @@ void sig_handler(int signum) {
 }
 
 
+/** @brief Sleep until the current cycle is over, a signal arrives, or @a wakeup (if any) reports a
+ *  temperature event. Fan timers (see FanDriver::next_timer()) are handled in between. */
+static void sleep_cycle(const Config &config, EventWakeup *wakeup)
+{
+	const auto cycle_end = std::chrono::steady_clock::now() + tmp_sleeptime;
+
+	while (likely(!interrupted)) {
+		auto until = cycle_end;
+		for (auto &fan_config : config.fan_configs())
+			if (opt<std::chrono::steady_clock::time_point> timer = fan_config->fan()->next_timer())
+				until = std::min(until, *timer);
+
+		bool woken = false;
+		if (wakeup)
+			woken = wakeup->sleep_until(until);
+		else
+			sleep_until(until);
+
+		if (unlikely(interrupted))
+			return;
+
+		for (auto &fan_config : config.fan_configs())
+			fan_config->fan()->handle_timer();
+
+		if (woken || std::chrono::steady_clock::now() >= cycle_end)
+			return;
+	}
+}
+
+
 void run(const Config &config)
 {
 	tmp_sleeptime = sleeptime;
+	SensorSweep sensor_sweep(config.sensors());
 
-	for (const unique_ptr<SensorDriver> &sensor : config.sensors())
-		sensor->read_temps();
+	sensor_sweep.read_temps();
+	temp_state.update();
 
 	// Set initial fan level
 	for (auto &fan_config : config.fan_configs())
 		fan_config->init_fanspeed(temp_state);
 	log(TF_NFY) << temp_state << " -> " << config.fan_configs() << flush;
 
+	// Unpublish the config for SIGUSR1 also when run() throws, since it's destroyed while unwinding
+	struct RunningConfigGuard {
+		RunningConfigGuard(const Config &config) { running_config = &config; }
+		~RunningConfigGuard() { running_config = nullptr; }
+	} running_config_guard(config);
+
+	unique_ptr<EventWakeup> wakeup;
+	if (event_wakeups)
+		wakeup.reset(new EventWakeup(config));
+
 	bool did_something = false;
 	while (likely(!interrupted)) {
-		sleep(tmp_sleeptime);
+		sleep_cycle(config, wakeup.get());
 
 		if (unlikely(interrupted))
 			break;
 
-		for (const unique_ptr<SensorDriver> &sensor : config.sensors())
-			sensor->read_temps();
+		sensor_sweep.read_temps();
+		temp_state.update();
 
 		if (unlikely(tolerate_errors) > 0)
 			tolerate_errors--;
@@ -190,8 +266,11 @@ void run(const Config &config)
 		for (auto &fan_config : config.fan_configs())
 			did_something |= fan_config->set_fanspeed(temp_state);
 
-		if (unlikely(did_something))
+		if (unlikely(did_something)) {
 			log(TF_NFY) << temp_state << " -> " << config.fan_configs() << flush;
+			if (wakeup)
+				wakeup->update_thresholds();
+		}
 
 		did_something = false;
 	}
@@ -200,7 +279,7 @@ void run(const Config &config)
 
 int set_options(int argc, char **argv)
 {
-	const char *optstring = "c:s:b:p::hqDznv"
+	const char *optstring = "c:s:b:p::a::ehqDznv"
 #ifdef USE_ATASMART
 			"d";
 #else
@@ -245,9 +324,8 @@ int set_options(int argc, char **argv)
 					s = int(std::stoul(arg, &invalid));
 					if (invalid < arg.length())
 						throw InvocationError(MSG_OPT_S_INVAL(optarg));
-					if (s > 15)
-						throw InvocationError(MSG_OPT_S_15(s));
-					else if (s < 0)
+					// Upper limit is checked below since it depends on -e
+					if (s < 0)
 						throw InvocationError("Negative sleep time? Seriously?");
 					else if (s < 1)
 						throw InvocationError(MSG_OPT_S_1(s));
@@ -290,12 +368,34 @@ int set_options(int argc, char **argv)
 			}
 			else depulse = 0.5f;
 			break;
+		case 'e':
+			event_wakeups = true;
+			break;
+		case 'a':
+			if (optarg) {
+				try {
+					size_t invalid;
+					string arg(optarg);
+					async_deadline = std::stof(arg, &invalid);
+					if (invalid < arg.length() || async_deadline > 10 || async_deadline <= 0)
+						error<InvocationError>(MSG_OPT_A(optarg));
+				} catch (std::invalid_argument &) {
+					throw InvocationError(MSG_OPT_A(optarg));
+				} catch (std::out_of_range &) {
+					throw InvocationError(MSG_OPT_A(optarg));
+				}
+			}
+			else async_deadline = 0.5f;
+			break;
 		default:
 			throw InvocationError(string("Unknown option: -") + static_cast<char>(optopt));
 		}
 	}
+	if (sleeptime > seconds(event_wakeups ? 60 : 15))
+		throw InvocationError(MSG_OPT_S_15(sleeptime.count()));
+
 	if (depulse > 0)
-		log(TF_NFY) << MSG_DEPULSE(depulse, sleeptime.count()) << flush;
+		log(TF_NFY) << MSG_DEPULSE(sleeptime.count(), depulse) << flush;
 
 	return 0;
 }
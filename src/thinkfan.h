@@ -96,6 +96,7 @@ class HwmonSensorDriver;
 class HwmonFanDriver;
 class TpSensorDriver;
 class TpFanDriver;
+class IOStatus;
 
 #ifdef USE_NVML
 class NvmlSensorDriver;
@@ -136,6 +137,7 @@ public:
 
 
 void sleep(thinkfan::seconds duration);
+void sleep_until(std::chrono::steady_clock::time_point until);
 
 void noop();
 
@@ -152,6 +154,8 @@ extern float bias_level;
 extern std::atomic<int> interrupted;
 extern vector<string> config_files;
 extern float depulse;
+extern float async_deadline;
+extern bool event_wakeups;
 extern std::atomic<unsigned char> tolerate_errors;
 
 extern std::condition_variable sleep_cond;
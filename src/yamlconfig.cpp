@@ -94,7 +94,7 @@ bool convert_driver<vector<wtf_ptr<HwmonSensorDriver>>>(
 		return false;
 
 	allowed_keywords(node, {
-		kw_hwmon, kw_correction, kw_name, kw_optional, kw_max_errors, kw_indices, kw_model
+		kw_hwmon, kw_correction, kw_name, kw_optional, kw_max_errors, kw_indices, kw_model, kw_interval
 	});
 
 	string path = node[kw_hwmon].as<string>();
@@ -150,7 +150,7 @@ bool convert_driver<wtf_ptr<TpSensorDriver>>(const Node &node, wtf_ptr<TpSensorD
 		return false;
 
 	allowed_keywords(node, {
-		kw_tpacpi, kw_correction, kw_indices, kw_optional, kw_max_errors
+		kw_tpacpi, kw_correction, kw_indices, kw_optional, kw_max_errors, kw_interval
 	});
 
 	opt<vector<int>> correction = decode_opt<vector<int>>(node[kw_correction]);
@@ -184,7 +184,7 @@ bool convert_driver<wtf_ptr<NvmlSensorDriver>>(const Node &node, wtf_ptr<NvmlSen
 		return false;
 
 	allowed_keywords(node, {
-		kw_nvidia, kw_correction, kw_optional, kw_max_errors
+		kw_nvidia, kw_correction, kw_optional, kw_max_errors, kw_interval
 	});
 
 	opt<vector<int>> correction = decode_opt<vector<int>>(node[kw_correction]);
@@ -206,14 +206,33 @@ bool convert_driver<wtf_ptr<AtasmartSensorDriver>>(const Node &node, wtf_ptr<Ata
 		return false;
 
 	allowed_keywords(node, {
-		kw_atasmart, kw_correction, kw_optional, kw_max_errors
+		kw_atasmart, kw_correction, kw_optional, kw_max_errors, kw_refresh_interval, kw_max_age, kw_interval
 	});
 
 	opt<vector<int>> correction = decode_opt<vector<int>>(node[kw_correction]);
 	bool optional = node[kw_optional] ? node[kw_optional].as<bool>() : false;
 	opt<unsigned int> max_errors = decode_opt<unsigned int>(node[kw_max_errors]);
+	opt<unsigned int> refresh_interval = decode_opt<unsigned int>(node[kw_refresh_interval]);
+	opt<unsigned int> max_age = decode_opt<unsigned int>(node[kw_max_age]);
+
+	if (refresh_interval && *refresh_interval == 0)
+		throw YamlError(get_mark_compat(node[kw_refresh_interval]), "'" + kw_refresh_interval + "' must be positive");
+	if (max_age && !refresh_interval)
+		throw YamlError(get_mark_compat(node[kw_max_age]), "'" + kw_max_age + "' requires a '" + kw_refresh_interval + "'");
+	if (max_age && *max_age < *refresh_interval)
+		throw YamlError(
+			get_mark_compat(node[kw_max_age]),
+			"'" + kw_max_age + "' must not be shorter than '" + kw_refresh_interval + "'"
+		);
 
-	sensor = make_wtf<AtasmartSensorDriver>(node[kw_atasmart].as<string>(), optional, correction, max_errors);
+	sensor = make_wtf<AtasmartSensorDriver>(
+		node[kw_atasmart].as<string>(),
+		optional,
+		correction,
+		max_errors,
+		refresh_interval ? opt<seconds>(seconds(*refresh_interval)) : nullopt,
+		max_age ? opt<seconds>(seconds(*max_age)) : nullopt
+	);
 
 	return true;
 }
@@ -228,7 +247,7 @@ bool convert_driver<wtf_ptr<LMSensorsDriver>>(const Node &node, wtf_ptr<LMSensor
 		return false;
 
 	allowed_keywords(node, {
-		kw_chip, kw_ids, kw_correction, kw_optional, kw_max_errors
+		kw_chip, kw_ids, kw_correction, kw_optional, kw_max_errors, kw_interval
 	});
 
 	if (!node[kw_ids]) {
@@ -280,7 +299,7 @@ bool convert_driver<vector<wtf_ptr<HwmonFanDriver>>>(const Node &node, vector<wt
 		return false;
 
 	allowed_keywords(node, {
-		kw_hwmon, kw_name, kw_indices, kw_optional, kw_max_errors, kw_levels
+		kw_hwmon, kw_name, kw_indices, kw_optional, kw_max_errors, kw_levels, kw_pid, kw_curve, kw_slew_rate
 	});
 
 	string path = node[kw_hwmon].as<string>();
@@ -300,8 +319,15 @@ bool convert_driver<vector<wtf_ptr<HwmonFanDriver>>>(const Node &node, vector<wt
 			"An optional hwmon fan must have an \"indices\" entry so thinkfan knows how many temperatures to expect."
 		);
 
-	for (unsigned int i = 0; i < (indices ? indices->size() : 1); ++i)
+	opt<unsigned int> slew_rate = decode_opt<unsigned int>(node[kw_slew_rate]);
+	if (slew_rate && *slew_rate == 0)
+		throw YamlError(get_mark_compat(node[kw_slew_rate]), "'" + kw_slew_rate + "' must be positive");
+
+	for (unsigned int i = 0; i < (indices ? indices->size() : 1); ++i) {
 		fans.push_back(wtf_ptr<HwmonFanDriver>(new HwmonFanDriver(hwmon_iface, optional, max_errors)));
+		if (slew_rate)
+			fans.back()->set_slew_rate(*slew_rate);
+	}
 
 	return true;
 }
@@ -316,6 +342,7 @@ struct convert<vector<wtf_ptr<SensorDriver>>> {
 		if (!node.IsSequence())
 			throw YamlError(get_mark_compat(node), "Sensor entries must be a sequence. Forgot the dashes?");
 		for (Node::const_iterator it = node.begin(); it != node.end(); ++it) {
+			size_t entry_start = sensors.size();
 			if ((*it)[kw_hwmon])
 				for (wtf_ptr<HwmonSensorDriver> h : it->as<vector<wtf_ptr<HwmonSensorDriver>>>())
 					sensors.push_back(std::move(h));
@@ -343,6 +370,14 @@ struct convert<vector<wtf_ptr<SensorDriver>>> {
 #endif // USE_LM_SENSORS
 			else
 				throw YamlError(get_mark_compat(*it), "Invalid sensor entry");
+
+			if ((*it)[kw_interval]) {
+				unsigned int interval = (*it)[kw_interval].as<unsigned int>();
+				if (interval == 0)
+					throw YamlError(get_mark_compat((*it)[kw_interval]), "'" + kw_interval + "' must be positive");
+				for (size_t i = entry_start; i < sensors.size(); ++i)
+					sensors[i]->set_interval(seconds(interval));
+			}
 		}
 
 		return sensors.size() > initial_size;
@@ -386,6 +421,60 @@ void assign_fan_levels(vector<unique_ptr<StepwiseMapping>> &fan_configs, const N
 
 
 
+PidMapping::Params decode_pid(const Node &node)
+{
+	if (!node.IsMap())
+		throw YamlError(get_mark_compat(node), "'" + kw_pid + "' must be a map of PID parameters");
+
+	allowed_keywords(node, {
+		kw_setpoint, kw_kp, kw_ki, kw_kd, kw_min_output, kw_max_output, kw_min_delta
+	});
+
+	if (!node[kw_setpoint])
+		throw YamlError(get_mark_compat(node), "Missing '" + kw_setpoint + "' entry");
+
+	PidMapping::Params params;
+	params.setpoint = node[kw_setpoint].as<float>();
+	params.kp = decode_opt<float>(node[kw_kp]).value_or(0);
+	params.ki = decode_opt<float>(node[kw_ki]).value_or(0);
+	params.kd = decode_opt<float>(node[kw_kd]).value_or(0);
+	params.min_output = decode_opt<int>(node[kw_min_output]).value_or(0);
+	params.max_output = decode_opt<int>(node[kw_max_output]).value_or(255);
+	params.min_delta = decode_opt<unsigned int>(node[kw_min_delta]).value_or(1);
+
+	if (params.kp == 0 && params.ki == 0 && params.kd == 0)
+		throw YamlError(get_mark_compat(node), "At least one of '" + kw_kp + "', '" + kw_ki + "' and '" + kw_kd + "' must be set");
+
+	return params;
+}
+
+
+
+unique_ptr<CurveMapping> decode_curve(unique_ptr<FanDriver> &&fan, const Node &node)
+{
+	if (!node.IsMap())
+		throw YamlError(get_mark_compat(node), "'" + kw_curve + "' must be a map with a '" + kw_points + "' entry");
+
+	allowed_keywords(node, { kw_points, kw_hysteresis });
+
+	const Node &n_points = node[kw_points];
+	if (!n_points || !n_points.IsSequence())
+		throw YamlError(get_mark_compat(node), "'" + kw_points + "' must be a sequence of [temperature, pwm] pairs");
+
+	vector<pair<int, int>> points;
+	for (const Node &n_point : n_points) {
+		if (!n_point.IsSequence() || n_point.size() != 2)
+			throw YamlError(get_mark_compat(n_point), "A curve point must be a [temperature, pwm] pair");
+		points.push_back({ n_point[0].as<int>(), n_point[1].as<int>() });
+	}
+
+	unsigned int hysteresis = decode_opt<unsigned int>(node[kw_hysteresis]).value_or(0);
+
+	return std::make_unique<CurveMapping>(std::move(fan), points, hysteresis);
+}
+
+
+
 template<>
 struct convert<vector<wtf_ptr<FanConfig>>> {
 	static bool decode(const Node &fans_node, vector<wtf_ptr<FanConfig>> &fan_configs)
@@ -405,7 +494,28 @@ struct convert<vector<wtf_ptr<FanConfig>>> {
 			}
 
 			const Node levels_node = (*fans_it)[kw_levels];
-			if (levels_node) {
+			const Node pid_node = (*fans_it)[kw_pid];
+			const Node curve_node = (*fans_it)[kw_curve];
+			if (int(bool(levels_node)) + int(bool(pid_node)) + int(bool(curve_node)) > 1)
+				throw YamlError(get_mark_compat(*fans_it),
+					"A fan can only have one of '" + kw_levels + "', '" + kw_pid + "' and '" + kw_curve + "'");
+
+			if (curve_node) {
+				for (unique_ptr<FanDriver> &fan_drv : fan_drivers)
+					fan_configs.push_back(wtf_ptr<FanConfig>(new unique_ptr<FanConfig>(
+						decode_curve(std::move(fan_drv), curve_node)
+					)));
+				fan_drivers.clear();
+			}
+			else if (pid_node) {
+				const PidMapping::Params params = decode_pid(pid_node);
+				for (unique_ptr<FanDriver> &fan_drv : fan_drivers)
+					fan_configs.push_back(wtf_ptr<FanConfig>(new unique_ptr<FanConfig>(
+						std::make_unique<PidMapping>(std::move(fan_drv), params)
+					)));
+				fan_drivers.clear();
+			}
+			else if (levels_node) {
 				if (!levels_node.IsSequence())
 					throw YamlError(
 						get_mark_compat(levels_node),
@@ -553,6 +663,27 @@ struct convert<wtf_ptr<SimpleLevel>> {
 };
 
 
+static Aggregate decode_aggregate(const Node &node)
+{
+	if (node.IsScalar()) {
+		const string kind = node.as<string>();
+		if (kind == kw_max)
+			return Aggregate();
+		else if (kind == kw_mean)
+			return Aggregate::mean();
+	}
+	else if (node.IsMap() && node.size() == 1) {
+		if (node[kw_weighted_mean])
+			return Aggregate::weighted_mean(node[kw_weighted_mean].as<vector<float>>());
+		else if (node[kw_kth_largest])
+			return Aggregate::kth_largest(node[kw_kth_largest].as<unsigned int>());
+	}
+
+	throw YamlError(get_mark_compat(node), "Invalid '" + kw_aggregate + "': Must be '" + kw_max + "', '" + kw_mean
+		+ "', '" + kw_weighted_mean + ": [...]' or '" + kw_kth_largest + ": <k>'");
+}
+
+
 bool convert<wtf_ptr<Config>>::decode(const Node &node, wtf_ptr<Config> &config)
 {
 	if (!node.size())
@@ -563,10 +694,13 @@ bool convert<wtf_ptr<Config>>::decode(const Node &node, wtf_ptr<Config> &config)
 	for (YAML::const_iterator it = node.begin(); it != node.end(); ++it) {
 		const string key = it->first.as<string>();
 
-		if (key != kw_sensors && key != kw_fans && key != kw_levels)
+		if (key != kw_sensors && key != kw_fans && key != kw_levels && key != kw_aggregate)
 			throw YamlError(get_mark_compat(it->first), "Unknown keyword");
 	}
 
+	if (node[kw_aggregate])
+		config->set_aggregate(decode_aggregate(node[kw_aggregate]));
+
 	if (node[kw_sensors]) {
 		for (auto s : node[kw_sensors].as<vector<wtf_ptr<SensorDriver>>>())
 			config->add_sensor(unique_ptr<SensorDriver>(s.release()));
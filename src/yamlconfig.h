@@ -15,6 +15,11 @@ using namespace thinkfan;
 const string kw_sensors("sensors");
 const string kw_fans("fans");
 const string kw_levels("levels");
+const string kw_aggregate("aggregate");
+const string kw_max("max");
+const string kw_mean("mean");
+const string kw_weighted_mean("weighted_mean");
+const string kw_kth_largest("kth_largest");
 const string kw_tpacpi("tpacpi");
 const string kw_hwmon("hwmon");
 #ifdef USE_NVML
@@ -22,6 +27,8 @@ const string kw_nvidia("nvml");
 #endif
 #ifdef USE_ATASMART
 const string kw_atasmart("atasmart");
+const string kw_refresh_interval("refresh_interval");
+const string kw_max_age("max_age");
 #endif
 #ifdef USE_LM_SENSORS
 const string kw_chip("chip");
@@ -36,6 +43,19 @@ const string kw_indices("indices");
 const string kw_correction("correction");
 const string kw_optional("optional");
 const string kw_max_errors("max_errors");
+const string kw_interval("interval");
+const string kw_pid("pid");
+const string kw_setpoint("setpoint");
+const string kw_kp("kp");
+const string kw_ki("ki");
+const string kw_kd("kd");
+const string kw_min_output("min_output");
+const string kw_max_output("max_output");
+const string kw_min_delta("min_delta");
+const string kw_curve("curve");
+const string kw_points("points");
+const string kw_hysteresis("hysteresis");
+const string kw_slew_rate("slew_rate");
 
 
 template<>